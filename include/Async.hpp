@@ -0,0 +1,315 @@
+/** @file Async.hpp
+ *  @brief file with asynchronous for_each variants
+ *
+ *  This contains for_each_async and friends, which launch a
+ *  for_each in the background and return an AsyncHandle,
+ *  and when_all, which combines handles
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _ASYNC_H
+#define _ASYNC_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "ForEach.hpp"
+
+namespace simbox{
+
+
+	namespace Detail{
+		/** @class AsyncQueue
+		 *  @brief background threads that run queued tasks
+		 *
+		 *  Helper threads are started only when every existing helper is
+		 *  busy, and are kept for later tasks, so launching a task does
+		 *  not normally create a thread. Because a helper is added
+		 *  whenever none is idle, a task that waits for another task can
+		 *  not starve it
+		 *
+		 */
+		class AsyncQueue{
+		public:
+			AsyncQueue()
+			: mIdle(0), mStop(false) {};
+
+			~AsyncQueue(){
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mStop = true;
+				}
+				mWake.notify_all();
+				for (auto it=mThreads.begin(); it!=mThreads.end(); it++) it->join();
+			}
+
+			AsyncQueue(const AsyncQueue &) = delete;
+			AsyncQueue & operator=(const AsyncQueue &) = delete;
+
+			// run "work" on a helper thread, and then "done". The helper
+			// counts as idle again before calling "done", so a caller woken
+			// by "done" that submits the next task reuses it
+			void submit(std::function<void()> work, std::function<void()> done = nullptr){
+				std::lock_guard<std::mutex> lock(mMutex);
+				mTasks.push_back(Task{std::move(work), std::move(done)});
+				if (mTasks.size() > mIdle) mThreads.emplace_back([this](){worker();});
+				else mWake.notify_one();
+			}
+
+			std::size_t num_threads() const {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return mThreads.size();
+			}
+
+			// the process-wide queue used by launch_async
+			static AsyncQueue & instance(){
+				static AsyncQueue q;
+				return q;
+			}
+
+		private:
+			struct Task{
+				std::function<void()> 		work;
+				std::function<void()> 		done;
+			};
+
+			void worker(){
+				std::unique_lock<std::mutex> lock(mMutex);
+				mIdle++;
+				while (true){
+					mWake.wait(lock, [this](){return mStop || !mTasks.empty();});
+					if (mTasks.empty()) return;
+
+					Task t = std::move(mTasks.front());
+					mTasks.pop_front();
+					mIdle--;
+					lock.unlock();
+					t.work();
+					lock.lock();
+					mIdle++;
+					if (t.done){
+						lock.unlock();
+						t.done();
+						lock.lock();
+					}
+				}
+			}
+
+			mutable std::mutex 						mMutex;
+			std::condition_variable 				mWake;
+			std::deque<Task> 						mTasks;
+			std::vector<std::thread> 				mThreads;
+			std::size_t 							mIdle;
+			bool 									mStop;
+		};
+
+
+		// completion state of one task. Continuations registered before the
+		// task finishes are called by the thread that finishes it
+		struct AsyncState{
+			std::mutex 								mutex;
+			std::condition_variable 				cv;
+			bool 									done = false;
+			std::exception_ptr 						error;
+			std::vector<std::function<void()>> 		continuations;
+
+			void finish(std::exception_ptr e){
+				std::vector<std::function<void()>> conts;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					done = true;
+					error = e;
+					conts.swap(continuations);
+				}
+				cv.notify_all();
+				for (auto it=conts.begin(); it!=conts.end(); it++) (*it)();
+			}
+
+			// call f once the task is done (right away if it already is)
+			void on_done(std::function<void()> f){
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!done){
+						continuations.push_back(std::move(f));
+						return;
+					}
+				}
+				f();
+			}
+
+			bool ready(){
+				std::lock_guard<std::mutex> lock(mutex);
+				return done;
+			}
+
+			void wait(){
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [this](){return done;});
+			}
+		};
+	} // end namespace Detail
+
+
+
+	/** @class AsyncHandle
+	 *  @brief a waitable handle to one or more background tasks
+	 *
+	 *  Handles are cheap to copy, and every copy refers to the same
+	 *  tasks. A default-constructed handle refers to no task and is
+	 *  always ready
+	 *
+	 */
+	class AsyncHandle{
+	public:
+		AsyncHandle() {};
+
+		// true if every task has finished
+		bool ready() const {
+			for (auto it=mStates.begin(); it!=mStates.end(); it++){
+				if (!(*it)->ready()) return false;
+			}
+			return true;
+		}
+
+		// block until every task has finished
+		void wait() const {
+			for (auto it=mStates.begin(); it!=mStates.end(); it++) (*it)->wait();
+		}
+
+		// block until every task has finished, and rethrow the first
+		// exception thrown by any of them
+		void get() const {
+			wait();
+			std::exception_ptr e = first_error();
+			if (e) std::rethrow_exception(e);
+		}
+
+		// queue f once every task of this handle is done. No thread waits
+		// in the meantime. If a task threw, f is skipped and the returned
+		// handle rethrows that exception
+		AsyncHandle then(std::function<void()> f) const {
+			AsyncHandle prev(*this), out(std::make_shared<Detail::AsyncState>());
+			std::shared_ptr<Detail::AsyncState> state = out.mStates.front();
+			if (mStates.empty()){
+				submit(state, f);
+				return out;
+			}
+
+			auto remaining = std::make_shared<std::atomic<std::size_t>>(mStates.size());
+			for (auto it=mStates.begin(); it!=mStates.end(); it++){
+				(*it)->on_done([prev, state, f, remaining](){
+					if (remaining->fetch_sub(1) != 1) return;
+					std::exception_ptr e = prev.first_error();
+					if (e) state->finish(e);
+					else submit(state, f);
+				});
+			}
+			return out;
+		}
+
+		// add the tasks of another handle to this one
+		AsyncHandle & operator+=(const AsyncHandle & h){
+			mStates.insert(mStates.end(), h.mStates.begin(), h.mStates.end());
+			return *this;
+		}
+
+	private:
+		friend AsyncHandle launch_async(std::function<void()> f);
+
+		explicit AsyncHandle(std::shared_ptr<Detail::AsyncState> s)
+		: mStates(1, s) {};
+
+		std::exception_ptr first_error() const {
+			for (auto it=mStates.begin(); it!=mStates.end(); it++){
+				if ((*it)->error) return (*it)->error;
+			}
+			return nullptr;
+		}
+
+		// run f on the background queue and finish the state with its result
+		static void submit(std::shared_ptr<Detail::AsyncState> state, std::function<void()> f){
+			Detail::AsyncQueue::instance().submit([state, f](){
+				try {f();}
+				catch (...) {state->error = std::current_exception();}
+			},
+			[state](){state->finish(state->error);});
+		}
+
+		std::vector<std::shared_ptr<Detail::AsyncState>> 		mStates;
+	};
+
+
+	// a handle that is ready once every given handle is ready
+	inline AsyncHandle when_all(const std::vector<AsyncHandle> & hs){
+		AsyncHandle out;
+		for (auto it=hs.begin(); it!=hs.end(); it++) out += *it;
+		return out;
+	}
+
+	template <typename... Handles>
+	AsyncHandle when_all(const AsyncHandle & h, const Handles & ... hs){
+		return when_all(std::vector<AsyncHandle>{h, hs...});
+	}
+
+
+	// launch a function on a background thread. Threads are reused
+	// between launches (see Detail::AsyncQueue)
+	inline AsyncHandle launch_async(std::function<void()> f){
+		AsyncHandle h(std::make_shared<Detail::AsyncState>());
+		AsyncHandle::submit(h.mStates.front(), f);
+		return h;
+	}
+
+
+
+	// asynchronous for_each. The loop runs serially on a background
+	// thread while the caller continues. The range and the arguments
+	// must stay valid until the handle is ready
+	//
+	// e.g.:	auto h = for_each_async<MyPolicy>(a.begin(), a.end(), PackOutput(), buffer);
+	// 			... solver continues ...
+	// 			h.wait();
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class Functor,
+			  typename... Args>
+	AsyncHandle for_each_async(IteratorType beg, IteratorType end, Functor u, Args... a){
+		return launch_async([beg, end, u, a...](){for_each<InterfacePolicy>(beg, end, u, a...);});
+	}
+
+	// asynchronous for_each with an execution policy (see ExecutionPolicy.hpp)
+	// for the background loop. With exec::pool the loop waits for any pool
+	// job the caller is running, since the pool runs one job at a time
+	//
+	// e.g.:	auto h = for_each_async<MyPolicy>(simbox::exec::pool, a.begin(), a.end(), PackOutput(), buffer);
+	template <class InterfacePolicy,
+			  class ExecutionPolicy,
+			  class IteratorType,
+			  class Functor,
+			  typename... Args>
+	typename std::enable_if<exec::is_execution_policy<ExecutionPolicy>::value, AsyncHandle>::type
+	for_each_async(ExecutionPolicy p, IteratorType beg, IteratorType end, Functor u, Args... a){
+		return launch_async([p, beg, end, u, a...](){for_each<InterfacePolicy>(p, beg, end, u, a...);});
+	}
+
+	// asynchronous for_each_parallel
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class Functor,
+			  typename... Args>
+	AsyncHandle for_each_parallel_async(IteratorType beg, IteratorType end, Functor u, Args... a){
+		return launch_async([beg, end, u, a...](){for_each_parallel<InterfacePolicy>(beg, end, u, a...);});
+	}
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,154 @@
+/** @file Coloring.hpp
+ *  @brief file with the ElementColoring class
+ *
+ *  This contains the ElementColoring class, which colors
+ *  elements so that no two elements of the same color share
+ *  a node, and for_each_colored, which runs the colors in
+ *  sequence with every color in parallel
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _COLORING_H
+#define _COLORING_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+
+#include "WorkStealing.hpp"
+
+namespace simbox{
+
+
+	/** @class ElementColoring
+	 *  @brief a partition of elements into conflict-free colors
+	 *
+	 *  Two elements conflict if they share a node. Elements are colored
+	 *  greedily in range order, each taking the lowest color that none of
+	 *  its nodes has been touched by yet. Element loops that scatter into
+	 *  nodes (assembly, node averaging) can then run each color in
+	 *  parallel without atomics or locks.
+	 *
+	 *  The nodes of an element are read through a ConnectivityPolicy,
+	 *  whose static get(element) returns something with begin() and end()
+	 *  over node indices.
+	 *
+	 *  e.g.:	struct ElementNodes{
+	 *  			static const std::vector<unsigned int> & get(const Element<3> & e) {return e.nodeinds;};
+	 *  		};
+	 *  		auto coloring = ElementColoring::color<ElementNodes>(elems.begin(), elems.end());
+	 *
+	 */
+	class ElementColoring{
+	public:
+		ElementColoring() {};
+
+		template <class ConnectivityPolicy, class IteratorType>
+		static ElementColoring color(IteratorType beg, IteratorType end){
+			ElementColoring out;
+
+			// one bit per color for every node, in words of 64 colors
+			std::vector<std::vector<std::uint64_t>> nodemask;
+			std::size_t e = 0;
+			for (auto it=beg; it!=end; it++, e++){
+				const auto & nodes = ConnectivityPolicy::get(*it);
+
+				// find the lowest color not yet used at any of the nodes
+				std::size_t c = 0;
+				for (std::size_t w=0; ; w++){
+					if (w == nodemask.size()) nodemask.push_back(std::vector<std::uint64_t>());
+					std::vector<std::uint64_t> & mask = nodemask[w];
+
+					std::uint64_t used = 0;
+					for (auto n=nodes.begin(); n!=nodes.end(); n++){
+						if (std::size_t(*n) < mask.size()) used |= mask[*n];
+					}
+					if (~used != 0){
+						unsigned int b = 0;
+						while ((used >> b) & 1) b++;
+						c = 64*w + b;
+						break;
+					}
+				}
+
+				// mark the color at every node of the element
+				std::vector<std::uint64_t> & mask = nodemask[c/64];
+				for (auto n=nodes.begin(); n!=nodes.end(); n++){
+					if (std::size_t(*n) >= mask.size()) mask.resize(std::size_t(*n)+1, 0);
+					mask[*n] |= (std::uint64_t(1) << (c%64));
+				}
+
+				if (c >= out.mColorSets.size()) out.mColorSets.resize(c+1);
+				out.mColorSets[c].push_back(e);
+				out.mColors.push_back(c);
+			}
+
+			return out;
+		}
+
+		std::size_t num_colors() const {return mColorSets.size();};
+		std::size_t num_elements() const {return mColors.size();};
+
+		// color of the e-th element of the colored range
+		std::size_t color(std::size_t e) const {return mColors[e];};
+
+		// positions (within the colored range) of the elements with color c,
+		// in increasing order
+		const std::vector<std::size_t> & color_set(std::size_t c) const {return mColorSets[c];};
+
+		void print_summary(std::ostream & os = std::cout) const {
+			os << "<ElementColoring elements=\"" << num_elements() << "\" colors=\"" << num_colors() << "\">" << std::endl;
+			for (std::size_t c=0; c<mColorSets.size(); c++){
+				os << "\t<Color id=\"" << c << "\" elements=\"" << mColorSets[c].size() << "\"/>" << std::endl;
+			}
+			os << "</ElementColoring>" << std::endl;
+		}
+
+	private:
+		std::vector<std::vector<std::size_t>> 		mColorSets;
+		std::vector<std::size_t> 					mColors;
+	};
+
+
+
+	// for_each iteration over the elements of a colored range. Colors run in
+	// sequence, and the elements of each color run in parallel. The first
+	// argument to the functor must be the dereferenced iterator type (after
+	// the interface policy). Following arguments are passed successively
+	// to the functor.
+	//
+	// The range must be the one the coloring was computed for. A range of
+	// a different size throws std::invalid_argument
+	//
+	// e.g.:	for_each_colored<MyPolicy>(coloring, elems.begin(), elems.end(), Assemble(), nodefield);
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class Functor,
+			  typename... Args>
+	void for_each_colored(const ElementColoring & coloring, IteratorType beg, IteratorType end, Functor u, Args... a){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_same<category, std::random_access_iterator_tag>::value, "Must be a random access iterator to run by color!");
+		if (std::size_t(end - beg) != coloring.num_elements()){
+			throw std::invalid_argument("for_each_colored: range has " + std::to_string(end - beg) + " elements but coloring has " + std::to_string(coloring.num_elements()));
+		}
+
+		WorkStealingExecutor ex;
+		for (std::size_t c=0; c<coloring.num_colors(); c++){
+			const std::vector<std::size_t> & set = coloring.color_set(c);
+			ex.run(set.size(), [&](std::size_t first, std::size_t last){
+				for (std::size_t i=first; i<last; i++){
+					u.operator()(InterfacePolicy::get(*(beg+set[i])), a...);
+				}
+			});
+		}
+	}
+
+
+} // end namespace simbox
+#endif
@@ -15,6 +15,9 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <tuple>
+#include <utility>
+#include <type_traits>
 
  namespace simbox{
 
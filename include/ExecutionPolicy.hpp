@@ -0,0 +1,109 @@
+/** @file ExecutionPolicy.hpp
+ *  @brief file with execution policy tags
+ *
+ *  This contains the execution policy tags used to
+ *  select a backend for the simbox::for_each family
+ *  at compile time (or at run time via exec::runtime)
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _EXECUTIONPOLICY_H
+#define _EXECUTIONPOLICY_H
+
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <type_traits>
+
+namespace simbox{
+namespace exec{
+
+	struct sequenced_policy {};			// plain serial loop
+	struct parallel_policy {};			// work-stealing threads (for_each_parallel)
+	struct simd_policy {};				// serial, vectorized with omp simd
+	struct parallel_simd_policy {};		// work-stealing threads, vectorized within each piece
+	struct omp_policy {};				// a single omp parallel for, static schedule
+	struct pool_policy {};				// work-stealing on the persistent ThreadPool::instance()
+	struct runtime_policy {};			// one of the above, chosen by runtime_kind()
+
+	constexpr sequenced_policy 		seq{};
+	constexpr parallel_policy 		par{};
+	constexpr simd_policy 			simd{};
+	constexpr parallel_simd_policy 	par_simd{};
+	constexpr omp_policy 			omp{};
+	constexpr pool_policy 			pool{};
+	constexpr runtime_policy 		runtime{};
+
+
+	template <typename T>
+	struct is_execution_policy : public std::false_type {};
+
+	template <> struct is_execution_policy<sequenced_policy> : public std::true_type {};
+	template <> struct is_execution_policy<parallel_policy> : public std::true_type {};
+	template <> struct is_execution_policy<simd_policy> : public std::true_type {};
+	template <> struct is_execution_policy<parallel_simd_policy> : public std::true_type {};
+	template <> struct is_execution_policy<omp_policy> : public std::true_type {};
+	template <> struct is_execution_policy<pool_policy> : public std::true_type {};
+	template <> struct is_execution_policy<runtime_policy> : public std::true_type {};
+
+
+
+	// the policy that is actually run for a requested policy. Building
+	// with SIMBOX_SERIAL defined turns every policy into seq, so that
+	// solver code can be debugged serially without touching call sites
+	template <typename Policy>
+	struct resolve{
+#ifdef SIMBOX_SERIAL
+		typedef sequenced_policy type;
+#else
+		typedef Policy type;
+#endif
+	};
+
+
+
+	// runtime-selectable policies
+	enum class policy_kind : unsigned int {SEQ=0, PAR, SIMD, PAR_SIMD, OMP, POOL};
+
+	inline std::string get_string(policy_kind k){
+		switch (k){
+			case policy_kind::SEQ: return "seq";
+			case policy_kind::PAR: return "par";
+			case policy_kind::SIMD: return "simd";
+			case policy_kind::PAR_SIMD: return "par_simd";
+			case policy_kind::OMP: return "omp";
+			case policy_kind::POOL: return "pool";
+		}
+		return "seq";
+	}
+
+	// parse a policy name (as given by get_string). Unknown names
+	// fall back to seq with a warning
+	inline policy_kind parse_policy(const std::string & s){
+		if (s == "seq") return policy_kind::SEQ;
+		if (s == "par") return policy_kind::PAR;
+		if (s == "simd") return policy_kind::SIMD;
+		if (s == "par_simd") return policy_kind::PAR_SIMD;
+		if (s == "omp") return policy_kind::OMP;
+		if (s == "pool") return policy_kind::POOL;
+		std::cerr << "exec::parse_policy: unknown policy \"" << s << "\", using seq" << std::endl;
+		return policy_kind::SEQ;
+	}
+
+	// the policy used by exec::runtime. This is initialized from the
+	// SIMBOX_EXEC_POLICY environment variable (default par_simd) and may
+	// be changed at any time with set_runtime_policy()
+	inline policy_kind & runtime_kind(){
+		static policy_kind k = (std::getenv("SIMBOX_EXEC_POLICY") == nullptr ? policy_kind::PAR_SIMD
+																			   : parse_policy(std::getenv("SIMBOX_EXEC_POLICY")));
+		return k;
+	}
+
+	inline void set_runtime_policy(policy_kind k) {runtime_kind() = k;};
+	inline void set_runtime_policy(const std::string & s) {runtime_kind() = parse_policy(s);};
+
+} // end namespace exec
+} // end namespace simbox
+#endif
@@ -0,0 +1,220 @@
+/** @file FlatMap.hpp
+ *  @brief file with a map stored as a sorted vector
+ *
+ *  This contains flat_map, an associative container with the
+ *  interface of std::map that keeps its (key, value) pairs
+ *  sorted in one contiguous array. Iteration is a linear scan
+ *  with random access iterators, lookups are binary searches,
+ *  and ranges of elements are inserted in a single merge
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _FLATMAP_H
+#define _FLATMAP_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <initializer_list>
+
+namespace simbox{
+
+
+	/** @class flat_map
+	 *  @brief a map of unique keys kept in a sorted vector
+	 *
+	 *  Suited to read-mostly data: building it with the range
+	 *  insert (or appending keys in ascending order) is linear,
+	 *  while inserting or erasing single keys in the middle moves
+	 *  the elements after them. Any insertion or erasure
+	 *  invalidates iterators and pointers to elements, as with
+	 *  std::vector, and changes generation(). The key of an element
+	 *  must not be modified through an iterator
+	 *
+	 */
+	template <typename KeyT, typename ValueT, typename Compare = std::less<KeyT>>
+	class flat_map{
+	public:
+		typedef KeyT 													key_type;
+		typedef ValueT 													mapped_type;
+		typedef std::pair<KeyT, ValueT> 								value_type;
+		typedef Compare 												key_compare;
+		typedef std::vector<value_type> 								storage_type;
+		typedef typename storage_type::iterator 						iterator;
+		typedef typename storage_type::const_iterator 					const_iterator;
+		typedef typename storage_type::size_type 						size_type;
+		typedef typename storage_type::difference_type 					difference_type;
+		typedef value_type & 											reference;
+		typedef const value_type & 										const_reference;
+
+		flat_map()
+		: mGeneration(0) {};
+
+		explicit flat_map(const Compare & comp)
+		: mComp(comp), mGeneration(0) {};
+
+		template <class InputIterator>
+		flat_map(InputIterator first, InputIterator last, const Compare & comp = Compare())
+		: mComp(comp), mGeneration(0) {insert(first, last);};
+
+		flat_map(std::initializer_list<value_type> il, const Compare & comp = Compare())
+		: mComp(comp), mGeneration(0) {insert(il.begin(), il.end());};
+
+		iterator begin() {return mData.begin();};
+		iterator end() {return mData.end();};
+		const_iterator begin() const {return mData.begin();};
+		const_iterator end() const {return mData.end();};
+		const_iterator cbegin() const {return mData.cbegin();};
+		const_iterator cend() const {return mData.cend();};
+
+		size_type size() const {return mData.size();};
+		bool empty() const {return mData.empty();};
+		void clear() {mData.clear(); mGeneration++;};
+		void reserve(size_type n) {mData.reserve(n); mGeneration++;};
+		size_type capacity() const {return mData.capacity();};
+		void shrink_to_fit() {mData.shrink_to_fit(); mGeneration++;};
+		key_compare key_comp() const {return mComp;};
+
+		// the underlying sorted array
+		const storage_type & data() const {return mData;};
+
+		// a count of the changes that may have moved elements (insertions,
+		// erasures and reallocations), so that anything that keeps pointers
+		// to elements can tell when to look them up again
+		std::size_t generation() const {return mGeneration;};
+
+
+
+		iterator lower_bound(const KeyT & k) {return std::lower_bound(mData.begin(), mData.end(), k, KeyLess(mComp));};
+		const_iterator lower_bound(const KeyT & k) const {return std::lower_bound(mData.begin(), mData.end(), k, KeyLess(mComp));};
+		iterator upper_bound(const KeyT & k) {return std::upper_bound(mData.begin(), mData.end(), k, KeyLess(mComp));};
+		const_iterator upper_bound(const KeyT & k) const {return std::upper_bound(mData.begin(), mData.end(), k, KeyLess(mComp));};
+
+		iterator find(const KeyT & k){
+			iterator it = lower_bound(k);
+			return (it != end() && !mComp(k, it->first)) ? it : end();
+		}
+
+		const_iterator find(const KeyT & k) const {
+			const_iterator it = lower_bound(k);
+			return (it != end() && !mComp(k, it->first)) ? it : end();
+		}
+
+		size_type count(const KeyT & k) const {return find(k) == end() ? 0 : 1;};
+
+		mapped_type & at(const KeyT & k){
+			iterator it = find(k);
+			if (it == end()) throw std::out_of_range("flat_map::at");
+			return it->second;
+		}
+
+		const mapped_type & at(const KeyT & k) const {
+			const_iterator it = find(k);
+			if (it == end()) throw std::out_of_range("flat_map::at");
+			return it->second;
+		}
+
+		mapped_type & operator[](const KeyT & k){
+			iterator it = lower_bound(k);
+			if (it == end() || mComp(k, it->first)){
+				it = mData.emplace(it, k, ValueT());
+				mGeneration++;
+			}
+			return it->second;
+		}
+
+
+
+		// insert one element, unless its key is already present. Keys
+		// larger than every other key are appended
+		std::pair<iterator, bool> insert(const value_type & v) {return insert(value_type(v));};
+
+		std::pair<iterator, bool> insert(value_type && v){
+			iterator it = lower_bound(v.first);
+			if (it != end() && !mComp(v.first, it->first)) return std::make_pair(it, false);
+			mGeneration++;
+			return std::make_pair(mData.insert(it, std::move(v)), true);
+		}
+
+		template <typename... Args>
+		std::pair<iterator, bool> emplace(Args && ... args) {return insert(value_type(std::forward<Args>(args)...));};
+
+		// insert a batch of elements. They are appended, sorted, and merged
+		// with the existing elements in one pass, instead of being inserted
+		// one by one. As with std::map, elements whose key is already present
+		// (or repeated earlier in the batch) are ignored
+		template <class InputIterator>
+		void insert(InputIterator first, InputIterator last){
+			const size_type n = mData.size();
+			mGeneration++;
+			mData.insert(mData.end(), first, last);
+			iterator mid = mData.begin() + n;
+			if (mid == mData.end()) return;
+
+			std::stable_sort(mid, mData.end(), PairLess(mComp));
+			if (mid != mData.begin() && !mComp((mid-1)->first, mid->first)){
+				std::inplace_merge(mData.begin(), mid, mData.end(), PairLess(mComp));
+			}
+			mData.erase(std::unique(mData.begin(), mData.end(), PairEqual(mComp)), mData.end());
+		}
+
+		void insert(std::initializer_list<value_type> il) {insert(il.begin(), il.end());};
+
+
+
+		size_type erase(const KeyT & k){
+			iterator it = find(k);
+			if (it == end()) return 0;
+			mData.erase(it);
+			mGeneration++;
+			return 1;
+		}
+
+		iterator erase(const_iterator pos) {mGeneration++; return mData.erase(pos);};
+		iterator erase(const_iterator first, const_iterator last) {mGeneration++; return mData.erase(first, last);};
+
+		// both maps count a change, since each now holds other elements
+		void swap(flat_map & other){
+			mData.swap(other.mData);
+			std::swap(mComp, other.mComp);
+			std::swap(mGeneration, other.mGeneration);
+			mGeneration++;
+			other.mGeneration++;
+		}
+
+		bool operator==(const flat_map & other) const {return mData == other.mData;};
+		bool operator!=(const flat_map & other) const {return mData != other.mData;};
+
+	private:
+		// comparisons of elements by key
+		struct KeyLess{
+			Compare c;
+			KeyLess(const Compare & comp) : c(comp) {};
+			bool operator()(const value_type & a, const KeyT & k) const {return c(a.first, k);};
+			bool operator()(const KeyT & k, const value_type & a) const {return c(k, a.first);};
+		};
+
+		struct PairLess{
+			Compare c;
+			PairLess(const Compare & comp) : c(comp) {};
+			bool operator()(const value_type & a, const value_type & b) const {return c(a.first, b.first);};
+		};
+
+		struct PairEqual{
+			Compare c;
+			PairEqual(const Compare & comp) : c(comp) {};
+			bool operator()(const value_type & a, const value_type & b) const {return !c(a.first, b.first) && !c(b.first, a.first);};
+		};
+
+		storage_type 		mData;
+		Compare 			mComp;
+		std::size_t 		mGeneration;
+	};
+
+
+} // end namespace simbox
+#endif
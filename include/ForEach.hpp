@@ -15,9 +15,20 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <tuple>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
 
 #include <omp.h>
 
+#include "Detail.hpp"
+#include "WorkStealing.hpp"
+#include "ExecutionPolicy.hpp"
+#include "Schedule.hpp"
+#include "ThreadPool.hpp"
+
  namespace simbox{
 
  	// for_each iteration over a general functor. The first argument to the functor
@@ -75,65 +86,425 @@
 	}
 
 
-	// parallelized version for random-access iterator types
+	namespace Detail{
+		// record an iterator to every "chunk"-th element of a forward range,
+		// followed by end, so that the chunks can be handed out by index
+		template <class IteratorType>
+		std::vector<IteratorType> chunk_starts(IteratorType beg, IteratorType end, std::size_t size, std::size_t chunk){
+			std::vector<IteratorType> starts;
+			starts.reserve(size/chunk + 2);
+			std::size_t ct = 0;
+			for (auto it=beg; it!=end; it++, ct++){
+				if (ct % chunk == 0) starts.push_back(it);
+			}
+			starts.push_back(end);
+			return starts;
+		}
+
+		// set the schedule used by "schedule(runtime)" loops for the
+		// lifetime of this object, and restore the previous one after
+		class ScopedOmpSchedule{
+		public:
+			ScopedOmpSchedule(const Schedule & s){
+				omp_get_schedule(&mKind, &mChunk);
+				switch (s.kind){
+					case ScheduleKind::STATIC: 	omp_set_schedule(omp_sched_static, s.chunk); break;
+					case ScheduleKind::DYNAMIC: omp_set_schedule(omp_sched_dynamic, s.chunk); break;
+					case ScheduleKind::GUIDED: 	omp_set_schedule(omp_sched_guided, s.chunk); break;
+					default: break;
+				}
+			}
+
+			~ScopedOmpSchedule() {omp_set_schedule(mKind, mChunk);};
+
+			ScopedOmpSchedule(const ScopedOmpSchedule &) = delete;
+			ScopedOmpSchedule & operator=(const ScopedOmpSchedule &) = delete;
+
+		private:
+			omp_sched_t 	mKind;
+			int 			mChunk;
+		};
+
+		// work-stealing loop over a random access range on a team of threads
+		template <class InterfacePolicy,
+				  class Team,
+				  class IteratorType,
+				  class Functor,
+				  typename... Args>
+		void for_each_stealing(std::random_access_iterator_tag, Team & team, std::size_t grain, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			WorkStealingExecutor ex(grain, team.num_threads());
+			ex.run(team, end - beg, [&](std::size_t first, std::size_t last){
+				for (std::size_t i=first; i<last; i++){
+					u.operator()(InterfacePolicy::get(*(beg+i)), a...);
+				}
+			});
+		}
+
+		// forward iterators (std::map, std::list, set_container, ...) are walked
+		// once to record chunk boundaries, and the chunks are then stolen
+		// like an ordinary index range
+		template <class InterfacePolicy,
+				  class Team,
+				  class IteratorType,
+				  class Functor,
+				  typename... Args>
+		void for_each_stealing(std::forward_iterator_tag, Team & team, std::size_t chunk, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			std::size_t size = std::distance(beg, end);
+			if (size == 0) return;
+
+			if (chunk == 0) chunk = std::max<std::size_t>(1, size/(32*team.num_threads()));
+			std::vector<IteratorType> starts = chunk_starts(beg, end, size, chunk);
+
+			WorkStealingExecutor ex(1, team.num_threads());
+			ex.run(team, starts.size()-1, [&](std::size_t first, std::size_t last){
+				for (auto it=starts[first]; it!=starts[last]; it++){
+					u.operator()(InterfacePolicy::get(*it), a...);
+				}
+			});
+		}
+
+		// random access iterators are split directly by index
+		template <class InterfacePolicy,
+				  class IteratorType,
+				  class Functor,
+				  typename... Args>
+		void for_each_parallel_impl(std::random_access_iterator_tag, const Schedule & s, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			if (s.kind == ScheduleKind::STEAL){
+				OmpTeam team;
+				for_each_stealing<InterfacePolicy>(std::random_access_iterator_tag(), team, s.chunk, beg, end, u, a...);
+				return;
+			}
+
+			std::ptrdiff_t size = end - beg;
+			ScopedOmpSchedule sched(s);
+			#pragma omp parallel for schedule(runtime)
+			for (std::ptrdiff_t i=0; i<size; i++){
+				u.operator()(InterfacePolicy::get(*(beg+i)), a...);
+			}
+		}
+
+		// forward iterators are chunked, and the chunks scheduled like an
+		// ordinary index range
+		template <class InterfacePolicy,
+				  class IteratorType,
+				  class Functor,
+				  typename... Args>
+		void for_each_parallel_impl(std::forward_iterator_tag, const Schedule & s, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			if (s.kind == ScheduleKind::STEAL){
+				OmpTeam team;
+				for_each_stealing<InterfacePolicy>(std::forward_iterator_tag(), team, s.chunk, beg, end, u, a...);
+				return;
+			}
+
+			std::size_t size = std::distance(beg, end);
+			std::size_t chunk = (s.chunk > 0 ? s.chunk : std::max<std::size_t>(1, size/(32*omp_get_max_threads())));
+			std::vector<IteratorType> starts = chunk_starts(beg, end, size, chunk);
+			std::ptrdiff_t nchunks = starts.size()-1;
+
+			// the chunk size was already applied when building "starts"
+			ScopedOmpSchedule sched(Schedule(s.kind, 1));
+			#pragma omp parallel for schedule(runtime)
+			for (std::ptrdiff_t c=0; c<nchunks; c++){
+				for (auto it=starts[c]; it!=starts[c+1]; it++){
+					u.operator()(InterfacePolicy::get(*it), a...);
+				}
+			}
+		}
+	} // end namespace Detail
+
+
+	// parallelized version for forward (or better) iterator types
 	// for_each iteration over a general functor. The first argument to the functor
 	// must be the dereferenced iterator type. Following arguments are passes successively
 	// to the functor.
 	//
-	// e.g.:	for_each<MyPolicy>(a.begin(), a.end(), Functor(), arg1, arg2);
-	// 			for_each<MyPolicy>(a.begin(), a.end(), Functor());
+	// The Schedule selects work stealing (the default, which keeps loops with uneven
+	// per-element cost balanced) or an OpenMP static/dynamic/guided schedule.
+	// Non random-access ranges are chunked.
+	//
+	// e.g.:	for_each_parallel<MyPolicy>(Schedule(ScheduleKind::DYNAMIC, 64), a.begin(), a.end(), Functor(), arg1);
+	template <class InterfacePolicy,
+			  class IteratorType, 
+			  class Functor,
+			  typename... Args>
+	void for_each_parallel(const Schedule & s, IteratorType beg, IteratorType end, Functor u, Args... a){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_base_of<std::forward_iterator_tag, category>::value, "Must be a forward iterator to parallelize!");
+		if (beg == end) return;
+
+		Detail::for_each_parallel_impl<InterfacePolicy>(category(), s, beg, end, u, a...);
+	}
+
+	// parallelized version using the schedule chosen by a ScheduleTuner. The tuner
+	// times the first few calls and then settles on the fastest schedule, so it
+	// should be kept alive across calls from the same call site
+	//
+	// e.g.:	static ScheduleTuner tuner;
+	// 			for_each_parallel<MyPolicy>(tuner, a.begin(), a.end(), Functor());
+	template <class InterfacePolicy,
+			  class IteratorType, 
+			  class Functor,
+			  typename... Args>
+	void for_each_parallel(ScheduleTuner & t, IteratorType beg, IteratorType end, Functor u, Args... a){
+		std::size_t size = std::distance(beg, end);
+		Schedule s = t.next(size);
+		double start = omp_get_wtime();
+		for_each_parallel<InterfacePolicy>(s, beg, end, u, a...);
+		t.record(size, omp_get_wtime() - start);
+	}
+
+	// parallelized version that keeps one ScheduleTuner for every
+	// combination of interface, iterator, and functor type. Each calling
+	// thread tunes its own, since a ScheduleTuner is not synchronized
+	//
+	// e.g.:	for_each_parallel<MyPolicy>(simbox::autotune, a.begin(), a.end(), Functor());
+	template <class InterfacePolicy,
+			  class IteratorType, 
+			  class Functor,
+			  typename... Args>
+	void for_each_parallel(AutoTune, IteratorType beg, IteratorType end, Functor u, Args... a){
+		static thread_local ScheduleTuner tuner;
+		for_each_parallel<InterfacePolicy>(tuner, beg, end, u, a...);
+	}
+
+	// parallelized version that runs on a persistent ThreadPool instead of
+	// opening an omp parallel region. The range is work-stolen between the
+	// pool threads. This avoids fork/join overhead for small loops that are
+	// called many times per time step
+	//
+	// e.g.:	for_each_parallel<MyPolicy>(ThreadPool::instance(), a.begin(), a.end(), Functor());
+	template <class InterfacePolicy,
+			  class IteratorType, 
+			  class Functor,
+			  typename... Args>
+	void for_each_parallel(ThreadPool & pool, IteratorType beg, IteratorType end, Functor u, Args... a){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_base_of<std::forward_iterator_tag, category>::value, "Must be a forward iterator to parallelize!");
+		if (beg == end) return;
+
+		Detail::for_each_stealing<InterfacePolicy>(category(), pool, 0, beg, end, u, a...);
+	}
+
+	// parallelized version using default_schedule()
+	//
+	// e.g.:	for_each_parallel<MyPolicy>(a.begin(), a.end(), Functor(), arg1, arg2);
+	// 			for_each_parallel<MyPolicy>(a.begin(), a.end(), Functor());
 	template <class InterfacePolicy,
 			  class IteratorType, 
 			  class Functor,
 			  typename... Args>
 	void for_each_parallel(IteratorType beg, IteratorType end, Functor u, Args... a){
-		static_assert(std::is_same<typename IteratorType::iterator_category, std::random_access_iterator_tag>::value, "Must be a random access iterator to parallelize!");
-		std::size_t size = end - beg;
-		if (size == 0) return;
+		for_each_parallel<InterfacePolicy>(default_schedule(), beg, end, u, a...);
+	}
+
+	// for_each iteration over a general iterator calling a unary function calling an interface functor
+	// on the iterator before each unary function call. The interface functor is provided at runtime
+	// by passing a functor argument
+ 	template <class IteratorType, 
+			  class Functor,
+			  class InterfaceFunctor,
+			  typename... Args>
+	void for_each_interface(IteratorType beg, IteratorType end, Functor u, InterfaceFunctor interf, Args... a){
+		std::for_each(beg, end, [&u, &interf, &a...](typename IteratorType::reference itr){return u(interf(itr), a...);});
+	}
 
 
 
-		// omp_lock_t writelock;
 
-		// omp_init_lock(&writelock);
+	// interface that passes the dereferenced iterator through unchanged.
+	// This is what the policy-tagged for_each uses when no InterfacePolicy is given
+	struct DirectInterface{
+		template <typename T>
+		static T && get(T && t) {return std::forward<T>(t);};
+	};
 
 
+	namespace Detail{
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::sequenced_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for (; beg!=end; beg++) u.operator()(InterfacePolicy::get(*beg), a...);
+		}
 
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::parallel_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for_each_parallel<InterfacePolicy>(beg, end, u, a...);
+		}
 
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_simd_range(IteratorType beg, std::ptrdiff_t first, std::ptrdiff_t last, Functor & u, Args & ... a){
+			#pragma omp simd
+			for (std::ptrdiff_t i=first; i<last; i++){
+				u.operator()(InterfacePolicy::get(*(beg+i)), a...);
+			}
+		}
 
-		// // std::cout << "size: " << size << std::endl;
-		// #pragma omp parallel default(shared)
-		// {
-		// 	omp_set_lock(&writelock);
-		// 	std::cout << "thread: " << omp_get_thread_num() << " begin: " << size*omp_get_thread_num()/omp_get_num_threads() << std::endl;
-  //   		omp_unset_lock(&writelock);
+		// vectorized and omp loops need random access. Other iterators
+		// are sent to the seq or par loops instead
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_simd_impl(std::random_access_iterator_tag, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for_each_simd_range<InterfacePolicy>(beg, 0, end - beg, u, a...);
+		}
 
-		// 	for (IteratorType it=beg+size*omp_get_thread_num()/omp_get_num_threads(); it!=end; it++){
-		// 		u.operator()(InterfacePolicy::get(*(it)), a...);
-		// 	}
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_simd_impl(std::input_iterator_tag, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for_each_policy_impl<InterfacePolicy>(exec::seq, beg, end, u, a...);
+		}
 
-		// }
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::simd_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+			for_each_simd_impl<InterfacePolicy>(category(), beg, end, u, a...);
+		}
 
-		// omp_destroy_lock(&writelock);
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_par_simd_impl(std::random_access_iterator_tag, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			WorkStealingExecutor ex;
+			ex.run(end - beg, [&](std::size_t first, std::size_t last){
+				for_each_simd_range<InterfacePolicy>(beg, first, last, u, a...);
+			});
+		}
 
-		// #pragma omp parallel default(shared)
-		// {
-			#pragma omp parallel for schedule(static) shared(beg,end,u)
-			for (int i=0; i<size; i++){
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_par_simd_impl(std::input_iterator_tag, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for_each_parallel<InterfacePolicy>(beg, end, u, a...);
+		}
+
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::parallel_simd_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+			for_each_par_simd_impl<InterfacePolicy>(category(), beg, end, u, a...);
+		}
+
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_omp_impl(std::random_access_iterator_tag, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			std::ptrdiff_t size = end - beg;
+			#pragma omp parallel for schedule(static)
+			for (std::ptrdiff_t i=0; i<size; i++){
 				u.operator()(InterfacePolicy::get(*(beg+i)), a...);
 			}
-		// }
+		}
+
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_omp_impl(std::input_iterator_tag, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for_each_parallel<InterfacePolicy>(beg, end, u, a...);
+		}
+
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::omp_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+			for_each_omp_impl<InterfacePolicy>(category(), beg, end, u, a...);
+		}
+
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::pool_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			for_each_parallel<InterfacePolicy>(ThreadPool::instance(), beg, end, u, a...);
+		}
+
+		template <class InterfacePolicy, class IteratorType, class Functor, typename... Args>
+		void for_each_policy_impl(exec::runtime_policy, IteratorType beg, IteratorType end, Functor & u, Args & ... a){
+			switch (exec::runtime_kind()){
+				case exec::policy_kind::SEQ: 		for_each_policy_impl<InterfacePolicy>(exec::seq, beg, end, u, a...); break;
+				case exec::policy_kind::PAR: 		for_each_policy_impl<InterfacePolicy>(exec::par, beg, end, u, a...); break;
+				case exec::policy_kind::SIMD: 		for_each_policy_impl<InterfacePolicy>(exec::simd, beg, end, u, a...); break;
+				case exec::policy_kind::PAR_SIMD: 	for_each_policy_impl<InterfacePolicy>(exec::par_simd, beg, end, u, a...); break;
+				case exec::policy_kind::OMP: 		for_each_policy_impl<InterfacePolicy>(exec::omp, beg, end, u, a...); break;
+				case exec::policy_kind::POOL: 		for_each_policy_impl<InterfacePolicy>(exec::pool, beg, end, u, a...); break;
+			}
+		}
+	} // end namespace Detail
+
+
+	// policy-tagged for_each iteration over a general functor. The execution
+	// policy is resolved at compile time (see ExecutionPolicy.hpp), or at run time
+	// for exec::runtime. The first argument to the functor must be the
+	// dereferenced iterator type. Following arguments are passed successively
+	// to the functor.
+	//
+	// e.g.:	for_each<MyPolicy>(simbox::exec::par_simd, a.begin(), a.end(), Functor(), arg1);
+	// 			for_each<MyPolicy>(simbox::exec::runtime, a.begin(), a.end(), Functor());
+	template <class InterfacePolicy,
+			  class ExecutionPolicy,
+			  class IteratorType, 
+			  class Functor,
+			  typename... Args>
+	typename std::enable_if<exec::is_execution_policy<ExecutionPolicy>::value>::type 
+	for_each(ExecutionPolicy, IteratorType beg, IteratorType end, Functor u, Args && ... a){
+		typedef typename exec::resolve<ExecutionPolicy>::type policy;
+		Detail::for_each_policy_impl<InterfacePolicy>(policy(), beg, end, u, a...);
 	}
 
-	// for_each iteration over a general iterator calling a unary function calling an interface functor
-	// on the iterator before each unary function call. The interface functor is provided at runtime
-	// by passing a functor argument
- 	template <class IteratorType, 
+	// policy-tagged for_each without an interface policy
+	//
+	// e.g.:	for_each(simbox::exec::par_simd, a.begin(), a.end(), Functor(), arg1, arg2);
+	template <class ExecutionPolicy,
+			  class IteratorType, 
 			  class Functor,
-			  class InterfaceFunctor,
 			  typename... Args>
-	void for_each_interface(IteratorType beg, IteratorType end, Functor u, InterfaceFunctor interf, Args... a){
-		std::for_each(beg, end, [&u, &interf, &a...](typename IteratorType::reference itr){return u(interf(itr), a...);});
+	typename std::enable_if<exec::is_execution_policy<ExecutionPolicy>::value>::type 
+	for_each(ExecutionPolicy, IteratorType beg, IteratorType end, Functor u, Args && ... a){
+		typedef typename exec::resolve<ExecutionPolicy>::type policy;
+		Detail::for_each_policy_impl<DirectInterface>(policy(), beg, end, u, a...);
+	}
+
+
+
+
+	// a functor that applies several functors, in order, to the same element.
+	// Passing one of these to any for_each variant fuses a chain of kernels
+	// into a single traversal of the container. Trailing arguments of the
+	// for_each are passed to every functor
+	template <class... Functors>
+	struct FusedFunctor{
+		std::tuple<Functors...> 		mFunctors;
+
+		FusedFunctor(Functors... f)
+		: mFunctors(f...) {};
+
+		template <typename T, typename... Args>
+		void operator()(T && t, Args && ... a){
+			Detail::for_each(mFunctors, [&t, &a...](auto & f){f(t, a...);});
+		}
+	};
+
+	// convenience function to create a fused functor
+	//
+	// e.g.:	for_each(simbox::exec::par, a.begin(), a.end(), make_fused(Update(), Clamp()));
+	template <class... Functors>
+	FusedFunctor<Functors...> make_fused(Functors... f){
+		return FusedFunctor<Functors...>(f...);
+	}
+
+
+	// for_each iteration that applies several unary functors to each element
+	// in one pass, in the order they are given
+	//
+	// e.g.:	for_each_fused(a.begin(), a.end(), Update(), Clamp(), Accumulate());
+	template <class IteratorType,
+			  class... Functors>
+	void for_each_fused(IteratorType beg, IteratorType end, Functors... f){
+		FusedFunctor<Functors...> fused(f...);
+		for (; beg!=end; beg++) fused(*beg);
+	}
+
+	// for_each_fused with an interface policy applied to each element
+	//
+	// e.g.:	for_each_fused<MyPolicy>(a.begin(), a.end(), Update(), Clamp(), Accumulate());
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class... Functors>
+	void for_each_fused(IteratorType beg, IteratorType end, Functors... f){
+		FusedFunctor<Functors...> fused(f...);
+		for (; beg!=end; beg++) fused(InterfacePolicy::get(*beg));
+	}
+
+	// parallelized version of for_each_fused (see for_each_parallel)
+	//
+	// e.g.:	for_each_fused_parallel<MyPolicy>(a.begin(), a.end(), Update(), Clamp(), Accumulate());
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class... Functors>
+	void for_each_fused_parallel(IteratorType beg, IteratorType end, Functors... f){
+		for_each_parallel<InterfacePolicy>(beg, end, FusedFunctor<Functors...>(f...));
 	}
 
 
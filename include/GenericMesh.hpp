@@ -96,7 +96,10 @@ template<typename T>
  *
  *  All other storage and responsibilities are delegated to the containers
  *  
- *  NodeContainerPolicy - Container that holds nodes... can be as key-value pairs or whatever you'd like
+ *  NodeContainerPolicy - Container that holds nodes... can be as key-value pairs or whatever you'd like.
+ *                  soa_node_container (SoANodeContainer.hpp) stores them as one array per component,
+ *                  and its first_touch_resize() places the pages of each array on the socket
+ *                  of the thread that later works on them (see Numa.hpp)
  *
  *  EdgeContainerPolicy - Container that holds edges... similarly, this is loosely defined
  *                  
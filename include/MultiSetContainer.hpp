@@ -9,6 +9,18 @@
 #include <type_traits>
 #include <algorithm>
 #include <functional>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "RoaringBitmap.hpp"
+#include "SetAlgebra.hpp"
+#include "SetExpression.hpp"
+#include "FlatMap.hpp"
+#include "ZipSort.hpp"
+#include "Range.hpp"
 
 namespace simbox{
 
@@ -36,6 +48,329 @@ struct key_type<std::pair<const key, value>>{
 	typedef key type;
 };
 
+template <typename key, typename value>
+struct key_type<std::pair<key, value>>{
+	typedef key type;
+};
+
+
+
+
+namespace Detail{
+	// a sorted copy of the keys of a set. Keys inserted in ascending order
+	// are appended as they come, and erased keys are collected and removed
+	// from the copy in one pass the next time it is asked for, so that
+	// removing keys one at a time stays O(1) each. Any other insertion
+	// marks the copy stale, and it is then rebuilt (into the same storage).
+	//
+	// Several threads may ask for the keys at once (e.g. set algebra on a
+	// const container); the update is done by one of them under a lock.
+	// Modifying the set while it is read is not allowed, as for any container
+	template <typename KeyT>
+	class SortedKeyCache{
+	public:
+		SortedKeyCache()
+		: mStale(false), mValid(true) {};
+
+		SortedKeyCache(const SortedKeyCache & other)
+		: mKeys(other.mKeys), mErased(other.mErased), mStale(other.mStale), mValid(other.mValid.load()) {};
+
+		SortedKeyCache & operator=(const SortedKeyCache & other){
+			mKeys = other.mKeys;
+			mErased = other.mErased;
+			mStale = other.mStale;
+			mValid.store(other.mValid.load());
+			return *this;
+		}
+
+		// a key was added to the set. Keys still waiting to be erased
+		// count as present, which only ever marks the copy stale
+		void inserted(KeyT k){
+			if (mStale) return;
+			if (mKeys.empty() || mKeys.back() < k) mKeys.push_back(k);
+			else invalidate();
+		}
+
+		// a key was removed from the set
+		void erased(KeyT k){
+			if (mStale) return;
+			mErased.push_back(k);
+			mValid.store(false, std::memory_order_relaxed);
+		}
+
+		// sorted, unique keys were removed from the set
+		void erased(const std::vector<KeyT> & keys){
+			if (keys.empty() || mStale) return;
+			remove_sorted(mKeys, keys);
+		}
+
+		void invalidate(){
+			mStale = true;
+			mErased.clear();
+			mValid.store(false, std::memory_order_relaxed);
+		}
+
+		void clear(){
+			mKeys.clear();
+			mErased.clear();
+			mStale = false;
+			mValid.store(true, std::memory_order_relaxed);
+		}
+
+		// the keys in ascending order, rebuilt from the key() of the set
+		// iterators if stale. "ordered" means the iterators already visit
+		// keys in ascending order
+		template <typename IteratorType>
+		const std::vector<KeyT> & get(IteratorType beg, IteratorType end, bool ordered) const {
+			if (!mValid.load(std::memory_order_acquire)){
+				std::lock_guard<std::mutex> lock(mMutex);
+				if (!mValid.load(std::memory_order_relaxed)){
+					if (mStale){
+						mKeys.clear();
+						for (auto it=beg; it!=end; it++) mKeys.push_back(it.key());
+						if (!ordered) std::sort(mKeys.begin(), mKeys.end());
+					}
+					else{
+						std::sort(mErased.begin(), mErased.end());
+						remove_sorted(mKeys, mErased);
+					}
+					mErased.clear();
+					mStale = false;
+					mValid.store(true, std::memory_order_release);
+				}
+			}
+			return mKeys;
+		}
+
+	private:
+		// remove the sorted "keys" from the sorted "from" in one pass
+		static void remove_sorted(std::vector<KeyT> & from, const std::vector<KeyT> & keys){
+			auto k = keys.begin();
+			from.erase(std::remove_if(from.begin(), from.end(), [&k, &keys](const KeyT & key){
+				while (k != keys.end() && *k < key) k++;
+				return k != keys.end() && !(key < *k);
+			}), from.end());
+		}
+
+		mutable std::vector<KeyT> 			mKeys;
+		mutable std::vector<KeyT> 			mErased;		// removed from the set, not yet from mKeys
+		mutable bool 						mStale;			// mKeys must be rebuilt
+		mutable std::atomic<bool> 			mValid;			// mKeys is up to date
+		mutable std::mutex 					mMutex;
+	};
+
+
+
+	// a number that is different for every call, which identifies an
+	// object to thread_local caches even if its address is reused
+	inline std::size_t next_instance_id(){
+		static std::atomic<std::size_t> id(0);
+		return ++id;
+	}
+
+
+
+	// the ids of the sets that one key belongs to. Ids below 64 are bits
+	// of a single word, and any larger ids are kept in a short sorted list,
+	// so testing, adding or removing a set costs the same no matter how
+	// many sets the key is in
+	class SetMask{
+	public:
+		SetMask()
+		: mBits(0) {};
+
+		bool test(unsigned int id) const {
+			if (id < 64) return (mBits >> id) & 1;
+			return std::binary_search(mMore.begin(), mMore.end(), id);
+		}
+
+		// returns true if the id was not set before
+		bool set(unsigned int id){
+			if (id < 64){
+				const std::uint64_t b = std::uint64_t(1) << id;
+				const bool added = !(mBits & b);
+				mBits |= b;
+				return added;
+			}
+			auto it = std::lower_bound(mMore.begin(), mMore.end(), id);
+			if (it != mMore.end() && *it == id) return false;
+			mMore.insert(it, id);
+			return true;
+		}
+
+		// returns true if the id was set before
+		bool reset(unsigned int id){
+			if (id < 64){
+				const std::uint64_t b = std::uint64_t(1) << id;
+				const bool removed = (mBits & b);
+				mBits &= ~b;
+				return removed;
+			}
+			auto it = std::lower_bound(mMore.begin(), mMore.end(), id);
+			if (it == mMore.end() || *it != id) return false;
+			mMore.erase(it);
+			return true;
+		}
+
+		bool empty() const {return mBits == 0 && mMore.empty();};
+		std::size_t count() const {return popcount64(mBits) + mMore.size();};
+
+		// call f(id) for every id, in ascending order
+		template <typename Functor>
+		void for_each(Functor f) const {
+			for (std::uint64_t w = mBits; w; w &= w-1) f(ctz64(w));
+			for (auto it=mMore.begin(); it!=mMore.end(); it++) f(*it);
+		}
+
+	private:
+		std::uint64_t 					mBits;
+		std::vector<unsigned int> 		mMore;
+	};
+
+
+
+	// the sets of every key in at least one set. The keys of a mapped
+	// container have a SetMask each, in a hash map. Keys of a vector
+	// container are indices (Dense): they index a vector of one 64 bit
+	// word per key directly, holding ids below 64, and the rare keys with
+	// larger ids keep those in a side hash map. A key then costs 8 bytes
+	// whatever its sets, up to the largest key in any set
+	template <typename KeyT, bool Dense>
+	class MembershipIndex{
+	public:
+		bool test(KeyT k, unsigned int id) const {
+			auto it = mMasks.find(k);
+			return it != mMasks.end() && it->second.test(id);
+		}
+
+		// returns true if the key was not in set "id" before
+		bool set(KeyT k, unsigned int id) {return mMasks[k].set(id);};
+
+		// returns true if the key was in set "id" before. Keys that are
+		// in no set anymore are dropped
+		bool reset(KeyT k, unsigned int id){
+			auto it = mMasks.find(k);
+			if (it == mMasks.end() || !it->second.reset(id)) return false;
+			if (it->second.empty()) mMasks.erase(it);
+			return true;
+		}
+
+		// the number of sets of a key
+		std::size_t count(KeyT k) const {
+			auto it = mMasks.find(k);
+			return it == mMasks.end() ? 0 : it->second.count();
+		}
+
+		// call f(id) for every set of a key, in ascending order
+		template <typename Functor>
+		void for_each(KeyT k, Functor f) const {
+			auto it = mMasks.find(k);
+			if (it != mMasks.end()) it->second.for_each(f);
+		}
+
+		// make room for n more keys, the largest of which is "last" (which
+		// only the dense index needs)
+		void reserve(KeyT, std::size_t n) {mMasks.reserve(mMasks.size() + n);};
+		void clear() {mMasks.clear();};
+
+		// true if set(k, id) may be called from several threads at once
+		// for distinct keys (after reserve). Never, for a hash map
+		bool concurrent_set(unsigned int) const {return false;};
+
+	private:
+		std::unordered_map<KeyT, SetMask> 	mMasks;
+	};
+
+	template <typename KeyT>
+	class MembershipIndex<KeyT, true>{
+	public:
+		bool test(KeyT k, unsigned int id) const {
+			if (id < 64) return std::size_t(k) < mBits.size() && ((mBits[k] >> id) & 1);
+			auto it = mMore.find(k);
+			return it != mMore.end() && std::binary_search(it->second.begin(), it->second.end(), id);
+		}
+
+		bool set(KeyT k, unsigned int id){
+			if (id < 64){
+				if (std::size_t(k) >= mBits.size()) mBits.resize(std::size_t(k)+1, 0);
+				const std::uint64_t b = std::uint64_t(1) << id;
+				const bool added = !(mBits[k] & b);
+				mBits[k] |= b;
+				return added;
+			}
+			std::vector<unsigned int> & more = mMore[k];
+			auto it = std::lower_bound(more.begin(), more.end(), id);
+			if (it != more.end() && *it == id) return false;
+			more.insert(it, id);
+			return true;
+		}
+
+		bool reset(KeyT k, unsigned int id){
+			if (id < 64){
+				const std::uint64_t b = std::uint64_t(1) << id;
+				if (std::size_t(k) >= mBits.size() || !(mBits[k] & b)) return false;
+				mBits[k] &= ~b;
+				return true;
+			}
+			auto mit = mMore.find(k);
+			if (mit == mMore.end()) return false;
+			auto it = std::lower_bound(mit->second.begin(), mit->second.end(), id);
+			if (it == mit->second.end() || *it != id) return false;
+			mit->second.erase(it);
+			if (mit->second.empty()) mMore.erase(mit);
+			return true;
+		}
+
+		std::size_t count(KeyT k) const {
+			std::size_t n = (std::size_t(k) < mBits.size() ? popcount64(mBits[k]) : 0);
+			if (mMore.empty()) return n;
+			auto it = mMore.find(k);
+			return it == mMore.end() ? n : n + it->second.size();
+		}
+
+		template <typename Functor>
+		void for_each(KeyT k, Functor f) const {
+			if (std::size_t(k) < mBits.size()){
+				for (std::uint64_t w = mBits[k]; w; w &= w-1) f(ctz64(w));
+			}
+			if (mMore.empty()) return;
+			auto it = mMore.find(k);
+			if (it != mMore.end()) for (auto id=it->second.begin(); id!=it->second.end(); id++) f(*id);
+		}
+
+		void reserve(KeyT last, std::size_t) {if (std::size_t(last) >= mBits.size()) mBits.resize(std::size_t(last)+1, 0);};
+
+		// distinct keys have distinct words, so ids below 64 can be set
+		// concurrently once the keys are reserved
+		bool concurrent_set(unsigned int id) const {return id < 64;};
+
+		void clear(){
+			mBits.clear();
+			mMore.clear();
+		}
+
+		// move the sets of key perm[i] to key i
+		void permute(const std::vector<std::size_t> & perm){
+			std::vector<std::uint64_t> bits(perm.size(), 0);
+			for (std::size_t i=0; i<perm.size(); i++){
+				if (perm[i] < mBits.size()) bits[i] = mBits[perm[i]];
+			}
+			mBits.swap(bits);
+
+			if (mMore.empty()) return;
+			std::vector<std::size_t> inv(perm.size());
+			for (std::size_t i=0; i<perm.size(); i++) inv[perm[i]] = i;
+			std::unordered_map<KeyT, std::vector<unsigned int>> more;
+			for (auto it=mMore.begin(); it!=mMore.end(); it++) more[KeyT(inv[it->first])] = std::move(it->second);
+			mMore.swap(more);
+		}
+
+	private:
+		std::vector<std::uint64_t> 										mBits;
+		std::unordered_map<KeyT, std::vector<unsigned int>> 			mMore;
+	};
+} // end namespace Detail
+
 
 
 
@@ -64,18 +399,11 @@ private:
 	    								  			value_type;
 	    typedef value_type &			  			reference;
 	    typedef value_type *						pointer;
-	    typedef std::random_access_iterator_tag		iterator_category;
+	    typedef std::forward_iterator_tag			iterator_category;	// unordered_map iterators only go forward
 
 		// construction
-		set_container_iterator(set_container * m, base_iterator it)
-		: mCont(m), mIt(it){};
-
-		// copy assignment
-		set_container_iterator & operator=(const set_container_iterator & cit){
-			set_container_iterator i(cit);
-			std::swap(i,*this);
-			return *this;
-		}
+		set_container_iterator(typename std::conditional<is_const, const set_container, set_container>::type * m, base_iterator it)
+		: mIt(it), mCont(m){};
 
 		pointer operator->() const {return mIt->second;};
 		reference operator*() const {return *mIt->second;};
@@ -126,263 +454,319 @@ public:
 
 	iterator find(KeyT k) {return iterator(this, base_type::find(k));};
 
+	// add a key and its element
+	std::pair<iterator, bool> insert(KeyT k, ValueT * v){
+		auto r = base_type::insert(std::make_pair(k, v));
+		if (r.second) mSorted.inserted(k);
+		return std::make_pair(iterator(this, r.first), r.second);
+	}
+
+	std::size_t erase(KeyT k){
+		std::size_t n = base_type::erase(k);
+		if (n) mSorted.erased(k);
+		return n;
+	}
+
+	void clear(){
+		base_type::clear();
+		mSorted.clear();
+	}
+
+	// add keys that are sorted, unique and not in the set yet
+	void insert_bulk(const std::vector<std::pair<KeyT, ValueT *>> & items){
+		base_type::reserve(base_type::size() + items.size());
+		for (auto it=items.begin(); it!=items.end(); it++){
+			base_type::emplace(it->first, it->second);
+			mSorted.inserted(it->first);
+		}
+	}
+
+	// remove keys that are sorted, unique and in the set
+	void erase_bulk(const std::vector<KeyT> & keys){
+		for (auto it=keys.begin(); it!=keys.end(); it++) base_type::erase(*it);
+		mSorted.erased(keys);
+	}
+
+	// the keys, in ascending order. This is cached between calls
+	// and only rebuilt after keys are inserted out of order
+	const std::vector<KeyT> & sorted_keys() const {return mSorted.get(cbegin(), cend(), false);};
+
+private:
+	Detail::SortedKeyCache<KeyT> 			mSorted;
 };
 // */
 
 
 
-/*
-// container that contains the sets with key-reference pairs
-// the iterator for this should be dereferenced as the same type
-// of iterator according to the key type
+
+// set container for dense integer keys (the indices of a set_vector),
+// storing membership in a compressed RoaringBitmap instead of a hash map.
+// Membership costs 2 bytes per key in sparse regions and 1 bit per key
+// in dense ones, membership tests are O(1), and set iteration visits
+// keys in ascending order. No sorted copy of the keys is kept, since it
+// would cost more than the bitmap itself; sorted_keys() builds one. Elements are found from the key and the
+// address of element 0, which MultiSetContainer passes with rebase()
+// on every insertion and every call to set(s), so that iteration stays
+// valid after the vector reallocates
 template <typename KeyT, typename ValueT>
-struct set_container : public std::vector<ValueT *>{
-private:
-	// static_assert(!is_pair<ValueT>::value, "This is a pair" );
-	typedef std::vector<ValueT *> 				base_type;
-	typedef std::unordered_map<KeyT, std::size_t>		key_storage_type;
-	typedef set_container 						set_self_type;
+struct bitmap_set_container{
+	static_assert(std::is_integral<KeyT>::value, "Bitmap sets need integer keys!");
+	static_assert(!is_pair<ValueT>::value, "Bitmap sets need index keys (e.g. set_vector), not mapped keys!");
 
-	key_storage_type 							mKeyStore;
+private:
+	typedef bitmap_set_container 					set_self_type;
 
 	template <bool is_const>
 	struct set_container_iterator{
 	private:
-		typedef typename std::conditional<is_const, typename base_type::const_iterator, typename base_type::iterator>::type base_iterator;
-		base_iterator 		mIt;
-		typename std::conditional<is_const, typename std::add_const<set_self_type>::type, set_self_type>::type * mCont;
+		RoaringBitmap::const_iterator 		mIt;
+		ValueT * 							mBase;
 	public:
-		typedef ValueT								orig_value_type;
 		typedef set_container_iterator				self_type;
 		typedef std::ptrdiff_t 						difference_type;
-	    typedef typename std::conditional<is_const, 
-    			typename std::add_const<orig_value_type>::type, 
-    			orig_value_type>::type 						
-	    								  			value_type;
-	    typedef value_type &			  			reference;
-	    typedef value_type *						pointer;
-	    typedef std::random_access_iterator_tag		iterator_category;
+		typedef typename std::conditional<is_const, const ValueT, ValueT>::type 	value_type;
+		typedef value_type &			  			reference;
+		typedef value_type *						pointer;
+		typedef std::forward_iterator_tag			iterator_category;
 
-		// construction
-		set_container_iterator(set_container * m, base_iterator it)
-		: mCont(m), mIt(it){};
+		set_container_iterator(RoaringBitmap::const_iterator it, ValueT * base)
+		: mIt(it), mBase(base) {};
 
-		// copy assignment
-		set_container_iterator & operator=(const set_container_iterator & cit){
-			set_container_iterator i(cit);
-			std::swap(i,*this);
-			return *this;
-		}
+		pointer operator->() const {return mBase + *mIt;};
+		reference operator*() const {return mBase[*mIt];};
 
-		pointer operator->() {return *mIt;};  // returns ValueT *
-		reference operator*() {return *(*mIt);}; // returns ValueT &
+		KeyT key() const {return KeyT(*mIt);};
 
-		// increment operators
-		self_type operator++(){
-			mIt++;
-			return *this;
-		}
-		self_type operator++(int blah){
-			mIt++;
-			return *this;
-		}
-		self_type operator+=(std::size_t n){
-			mIt += n;
-			return *this;
-		}
-
-		// decrement operators
-		self_type operator--(){
-			mIt--;
-			return *this;
-		}
-		self_type operator--(int blah){
-			mIt--;
-			return *this;
-		}
-		self_type operator-=(std::size_t n){
-			mIt -= n;
-			return *this;
-		}
-		
+		self_type & operator++() {++mIt; return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++mIt; return out;};
 
-		// equivalence operators
 		bool operator!=(const self_type & leaf) const {return mIt != leaf.mIt;};
 		bool operator==(const self_type & leaf) const {return mIt == leaf.mIt;};
-
-		// random access operators
-		difference_type operator-(const self_type & it) const {
-			return mIt - it.mIt;
-		}
-		self_type operator-(std::size_t n) const {
-			return self_type(mCont, mIt - n);
-		}
-		self_type operator+(std::size_t n) const {
-			return self_type(mCont, mIt + n);
-		}
-		
 	};
 
 public:
-
+	typedef KeyT 							key_type;
 	typedef set_container_iterator<true> 	const_iterator;
 	typedef set_container_iterator<false> 	iterator;
 
-	iterator begin() {return iterator(this, base_type::begin());};
-	iterator end()	 {return iterator(this, base_type::end());};
+	bitmap_set_container()
+	: mBase(nullptr) {};
 
-	const_iterator cbegin() const {return const_iterator(this, base_type::cbegin());};
-	const_iterator cend() const	 {return const_iterator(this, base_type::cend());};
+	iterator begin() {return iterator(mBits.begin(), mBase);};
+	iterator end()	 {return iterator(mBits.end(), mBase);};
 
+	const_iterator cbegin() const {return const_iterator(mBits.begin(), mBase);};
+	const_iterator cend() const	 {return const_iterator(mBits.end(), mBase);};
 
-	iterator find(KeyT k) {
-		auto kit = mKeyStore.find(k);
-		return (kit == mKeyStore.end() ? iterator(this, base_type::end()) : iterator(this, base_type::begin()+kit->second));
-	};
+	iterator find(KeyT k) {return iterator(mBits.find(k), mBase);};
+
+	// the address of element 0, from which elements are found
+	void rebase(ValueT * base) {mBase = base;};
 
-	iterator insert(KeyT k, ValueT * v){
-		base_type::push_back(v);
-		mKeyStore[k] = base_type::size()-1;
+	// add a key (the element is found from the base)
+	std::pair<iterator, bool> insert(KeyT k, ValueT *){
+		bool added = mBits.add(k);
+		return std::make_pair(find(k), added);
 	}
 
+	std::size_t erase(KeyT k) {return mBits.remove(k) ? 1 : 0;};
 
-};
-// */
+	std::size_t count(KeyT k) const {return mBits.contains(k) ? 1 : 0;};
 
+	std::size_t size() const {return mBits.cardinality();};
+	bool empty() const {return mBits.empty();};
+	void clear() {mBits.clear();};
 
+	// add keys that are sorted, unique and not in the set yet
+	void insert_bulk(const std::vector<std::pair<KeyT, ValueT *>> & items){
+		for (auto it=items.begin(); it!=items.end(); it++) mBits.add(it->first);
+	}
 
+	// remove keys that are sorted, unique and in the set
+	void erase_bulk(const std::vector<KeyT> & keys){
+		for (auto it=keys.begin(); it!=keys.end(); it++) mBits.remove(*it);
+	}
+
+	const RoaringBitmap & bitmap() const {return mBits;};
+
+	// the keys, in ascending order, decoded from the bitmap on every call.
+	// Set algebra on bitmap sets uses the bitmaps instead
+	std::vector<KeyT> sorted_keys() const {return mBits.to_vector<KeyT>();};
+
+	// bytes of heap and object storage in use by the set
+	std::size_t memory_bytes() const {return sizeof(*this) - sizeof(RoaringBitmap) + mBits.memory_bytes();};
 
-/*
-// container that contains the sets with key-reference pairs
-// the iterator for this should be dereferenced as the same type
-// of iterator according to the key type
-template <typename KeyT, typename ValueT>
-struct set_container : public std::vector<ValueT *>{
 private:
-	// static_assert(!is_pair<ValueT>::value, "This is a pair" );
-	typedef std::vector<ValueT *> 				base_type;
-	typedef std::unordered_map<KeyT, std::size_t>		key_storage_type;
-	typedef set_container 						set_self_type;
+	RoaringBitmap 					mBits;
+	ValueT * 						mBase;
+};
 
-	// typedef  base_iterator;
-	typedef typename base_type::iterator base_iterator;
 
-	key_storage_type 							mKeyStore;
 
 
+
+
+
+// set container that keeps its keys in a sorted contiguous array, with
+// the element pointers in a parallel array. Iteration is random access in
+// ascending key order, so for_each_parallel can split a set directly and
+// the key array streams through the cache. Lookups are binary searches,
+// and inserting keys in ascending order only appends
+template <typename KeyT, typename ValueT>
+struct sorted_set_container{
+private:
+	typedef sorted_set_container 					set_self_type;
+
 	template <bool is_const>
-	struct set_container_iterator : public base_iterator {
+	struct set_container_iterator{
 	private:
-		typedef typename std::conditional<is_const, typename base_type::const_iterator, typename base_type::iterator>::type base_iterator;
-		base_iterator 		mIt;
-		typename std::conditional<is_const, typename std::add_const<set_self_type>::type, set_self_type>::type * mCont;
+		typedef typename std::conditional<is_const, const set_self_type, set_self_type>::type container_type;
+		container_type * 		mCont;
+		std::size_t 			mIndex;
 	public:
-		typedef ValueT								orig_value_type;
 		typedef set_container_iterator				self_type;
 		typedef std::ptrdiff_t 						difference_type;
-	    typedef typename std::conditional<is_const, 
-    			typename std::add_const<orig_value_type>::type, 
-    			orig_value_type>::type 						
-	    								  			value_type;
-	    typedef value_type &			  			reference;
-	    typedef value_type *						pointer;
-	    typedef std::random_access_iterator_tag		iterator_category;
-
-	    using base_iterator::base_iterator;
-		// // construction
-		// set_container_iterator(set_container * m, base_iterator it)
-		// : mCont(m), mIt(it){};
-
-		// // copy assignment
-		// set_container_iterator & operator=(const set_container_iterator & cit){
-		// 	set_container_iterator i(cit);
-		// 	std::swap(i,*this);
-		// 	return *this;
-		// }
-
-		pointer operator->() {return *(*base_iterator::operator*());};  // returns ValueT *
-		reference operator*() {return *(*(*(base_iterator::operator*())));}; // returns ValueT &
-
-		// // increment operators
-		// self_type operator++(){
-		// 	mIt++;
-		// 	return *this;
-		// }
-		// self_type operator++(int blah){
-		// 	mIt++;
-		// 	return *this;
-		// }
-		// self_type operator+=(std::size_t n){
-		// 	mIt += n;
-		// 	return *this;
-		// }
-
-		// // decrement operators
-		// self_type operator--(){
-		// 	mIt--;
-		// 	return *this;
-		// }
-		// self_type operator--(int blah){
-		// 	mIt--;
-		// 	return *this;
-		// }
-		// self_type operator-=(std::size_t n){
-		// 	mIt -= n;
-		// 	return *this;
-		// }
-		
-
-		// // equivalence operators
-		// bool operator!=(const self_type & leaf) const {return mIt != leaf.mIt;};
-		// bool operator==(const self_type & leaf) const {return mIt == leaf.mIt;};
-
-		// // random access operators
-		// difference_type operator-(const self_type & it) const {
-		// 	return mIt - it.mIt;
-		// }
-		// self_type operator-(std::size_t n) const {
-		// 	return self_type(mCont, mIt - n);
-		// }
-		// self_type operator+(std::size_t n) const {
-		// 	return self_type(mCont, mIt + n);
-		// }
-		
+		typedef typename std::conditional<is_const, const ValueT, ValueT>::type 	value_type;
+		typedef value_type &			  			reference;
+		typedef value_type *						pointer;
+		typedef std::random_access_iterator_tag		iterator_category;
+
+		set_container_iterator(container_type * m, std::size_t i)
+		: mCont(m), mIndex(i) {};
+
+		pointer operator->() const {return mCont->mValues[mIndex];};
+		reference operator*() const {return *mCont->mValues[mIndex];};
+		reference operator[](difference_type n) const {return *mCont->mValues[mIndex + n];};
+
+		KeyT key() const {return mCont->mKeys[mIndex];};
+
+		// increment operators
+		self_type & operator++() {++mIndex; return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++mIndex; return out;};
+
+		// decrement operators
+		self_type & operator--() {--mIndex; return *this;};
+		self_type operator--(int blah) {self_type out(*this); --mIndex; return out;};
+
+		// random access operators
+		self_type & operator+=(difference_type n) {mIndex += n; return *this;};
+		self_type & operator-=(difference_type n) {mIndex -= n; return *this;};
+		self_type operator+(difference_type n) const {return self_type(mCont, mIndex + n);};
+		self_type operator-(difference_type n) const {return self_type(mCont, mIndex - n);};
+		difference_type operator-(const self_type & it) const {return difference_type(mIndex) - difference_type(it.mIndex);};
+
+		// equivalence operators
+		bool operator!=(const self_type & leaf) const {return mIndex != leaf.mIndex;};
+		bool operator==(const self_type & leaf) const {return mIndex == leaf.mIndex;};
+		bool operator<(const self_type & leaf) const {return mIndex < leaf.mIndex;};
+		bool operator>(const self_type & leaf) const {return mIndex > leaf.mIndex;};
+		bool operator<=(const self_type & leaf) const {return mIndex <= leaf.mIndex;};
+		bool operator>=(const self_type & leaf) const {return mIndex >= leaf.mIndex;};
 	};
 
 public:
-
+	typedef KeyT 							key_type;
 	typedef set_container_iterator<true> 	const_iterator;
 	typedef set_container_iterator<false> 	iterator;
 
-	using base_type::begin;
-	using base_type::end;
-	using base_type::cbegin;
-	using base_type::cend;
-	// iterator begin() {return iterator(this, base_type::begin());};
-	// iterator end()	 {return iterator(this, base_type::end());};
+	iterator begin() {return iterator(this, 0);};
+	iterator end()	 {return iterator(this, mKeys.size());};
+
+	const_iterator cbegin() const {return const_iterator(this, 0);};
+	const_iterator cend() const	 {return const_iterator(this, mKeys.size());};
 
-	// const_iterator cbegin() const {return const_iterator(this, base_type::cbegin());};
-	// const_iterator cend() const	 {return const_iterator(this, base_type::cend());};
+	iterator find(KeyT k) {return iterator(this, find_index(k));};
 
+	// add a key and its element
+	std::pair<iterator, bool> insert(KeyT k, ValueT * v){
+		if (mKeys.empty() || mKeys.back() < k){
+			mKeys.push_back(k);
+			mValues.push_back(v);
+			return std::make_pair(iterator(this, mKeys.size()-1), true);
+		}
+		std::size_t i = std::lower_bound(mKeys.begin(), mKeys.end(), k) - mKeys.begin();
+		if (mKeys[i] == k) return std::make_pair(iterator(this, i), false);
+		mKeys.insert(mKeys.begin()+i, k);
+		mValues.insert(mValues.begin()+i, v);
+		return std::make_pair(iterator(this, i), true);
+	}
 
-	// iterator find(KeyT k) {
-	// 	auto kit = mKeyStore.find(k);
-	// 	return (kit == mKeyStore.end() ? iterator(this, base_type::end()) : iterator(this, base_type::begin()+kit->second));
-	// };
+	std::size_t erase(KeyT k){
+		std::size_t i = find_index(k);
+		if (i == mKeys.size()) return 0;
+		mKeys.erase(mKeys.begin()+i);
+		mValues.erase(mValues.begin()+i);
+		return 1;
+	}
 
-	iterator find(KeyT k) {
-		auto kit = mKeyStore.find(k);
-		return (kit == mKeyStore.end() ? iterator(base_type::end()) : iterator(base_type::begin() + kit->second));
-	};
+	std::size_t count(KeyT k) const {return find_index(k) == mKeys.size() ? 0 : 1;};
+
+	std::size_t size() const {return mKeys.size();};
+	bool empty() const {return mKeys.empty();};
+	void clear() {mKeys.clear(); mValues.clear();};
+	void reserve(std::size_t n) {mKeys.reserve(n); mValues.reserve(n);};
+
+	// add keys that are sorted, unique and not in the set yet. Keys above
+	// the current largest are appended, otherwise both arrays are merged
+	// in one pass
+	void insert_bulk(const std::vector<std::pair<KeyT, ValueT *>> & items){
+		if (items.empty()) return;
+		if (mKeys.empty() || mKeys.back() < items.front().first){
+			reserve(mKeys.size() + items.size());
+			for (auto it=items.begin(); it!=items.end(); it++){
+				mKeys.push_back(it->first);
+				mValues.push_back(it->second);
+			}
+			return;
+		}
 
-	iterator insert(KeyT k, ValueT * v){
-		base_type::push_back(v);
-		mKeyStore[k] = base_type::size()-1;
+		std::vector<KeyT> keys;
+		std::vector<ValueT *> values;
+		keys.reserve(mKeys.size() + items.size());
+		values.reserve(mKeys.size() + items.size());
+		std::size_t i = 0;
+		for (auto it=items.begin(); it!=items.end(); it++){
+			while (i < mKeys.size() && mKeys[i] < it->first){
+				keys.push_back(mKeys[i]);
+				values.push_back(mValues[i]);
+				i++;
+			}
+			keys.push_back(it->first);
+			values.push_back(it->second);
+		}
+		keys.insert(keys.end(), mKeys.begin()+i, mKeys.end());
+		values.insert(values.end(), mValues.begin()+i, mValues.end());
+		mKeys.swap(keys);
+		mValues.swap(values);
+	}
+
+	// remove keys that are sorted, unique and in the set, compacting
+	// both arrays in one pass
+	void erase_bulk(const std::vector<KeyT> & keys){
+		std::size_t out = 0, r = 0;
+		for (std::size_t i=0; i<mKeys.size(); i++){
+			while (r < keys.size() && keys[r] < mKeys[i]) r++;
+			if (r < keys.size() && keys[r] == mKeys[i]) continue;
+			mKeys[out] = mKeys[i];
+			mValues[out] = mValues[i];
+			out++;
+		}
+		mKeys.resize(out);
+		mValues.resize(out);
 	}
 
+	// the keys, in ascending order
+	const std::vector<KeyT> & sorted_keys() const {return mKeys;};
+
+private:
+	std::size_t find_index(KeyT k) const {
+		auto it = std::lower_bound(mKeys.begin(), mKeys.end(), k);
+		return (it != mKeys.end() && *it == k) ? it - mKeys.begin() : mKeys.size();
+	}
 
+	std::vector<KeyT> 			mKeys;
+	std::vector<ValueT *> 		mValues;
 };
-// */
 
 
 
@@ -395,6 +779,85 @@ public:
 
 
 
+namespace Detail{
+	// write the keys of the result of a logical operation, in ascending
+	// order, to "out" and return their number. A pointer must hold
+	// max_result_size(op, c1.size(), c2.size()) keys, and a vector is
+	// resized to the result. Sets merge their sorted keys in parallel
+	template <typename SetContainer, typename KeyT>
+	std::size_t set_algebra(SetOperation op, const SetContainer & c1, const SetContainer & c2, KeyT * out){
+		const std::vector<KeyT> & k1 = c1.sorted_keys();
+		const std::vector<KeyT> & k2 = c2.sorted_keys();
+		return parallel_set_operation(op, k1.data(), k1.size(), k2.data(), k2.size(), out);
+	}
+
+	template <typename SetContainer, typename KeyT>
+	std::size_t set_algebra(SetOperation op, const SetContainer & c1, const SetContainer & c2, std::vector<KeyT> & out){
+		return parallel_set_operation(op, c1.sorted_keys(), c2.sorted_keys(), out);
+	}
+
+	// while bitmap sets combine their bitmaps word by word
+	template <typename KeyT, typename ValueT>
+	std::size_t set_algebra(SetOperation op, const bitmap_set_container<KeyT, ValueT> & c1, const bitmap_set_container<KeyT, ValueT> & c2, KeyT * out){
+		return bitmap_set_operation(op, c1.bitmap(), c2.bitmap()).copy_to(out);
+	}
+
+	template <typename KeyT, typename ValueT>
+	std::size_t set_algebra(SetOperation op, const bitmap_set_container<KeyT, ValueT> & c1, const bitmap_set_container<KeyT, ValueT> & c2, std::vector<KeyT> & out){
+		RoaringBitmap r = bitmap_set_operation(op, c1.bitmap(), c2.bitmap());
+		out.resize(r.cardinality());
+		return r.copy_to(out.data());
+	}
+
+	// a set as a term of a set expression
+	template <typename SetContainer>
+	SetTerminal<typename SetContainer::key_type> set_terminal(const SetContainer & c) {return SetTerminal<typename SetContainer::key_type>(c.sorted_keys());};
+
+	template <typename KeyT, typename ValueT>
+	BitmapSetTerminal<KeyT> set_terminal(const bitmap_set_container<KeyT, ValueT> & c) {return BitmapSetTerminal<KeyT>(c.bitmap());};
+
+	// pass the address of element 0 to sets that find their elements
+	// from it. Other sets store a pointer per element
+	template <typename SetContainer, typename ValueT>
+	void rebase_set(SetContainer &, ValueT *) {};
+
+	template <typename KeyT, typename ValueT>
+	void rebase_set(bitmap_set_container<KeyT, ValueT> & c, ValueT * base) {c.rebase(base);};
+
+	// point a set at the current storage of its elements. Sets that store
+	// a pointer per element look each one up again with resolve(key)
+	template <typename SetContainer, typename ValueT, typename Resolver>
+	void relink_set(SetContainer & c, ValueT *, Resolver resolve){
+		std::vector<std::pair<typename SetContainer::key_type, ValueT *>> items;
+		const auto & keys = c.sorted_keys();
+		items.reserve(keys.size());
+		for (auto k=keys.begin(); k!=keys.end(); k++) items.emplace_back(*k, resolve(*k));
+		c.clear();
+		c.insert_bulk(items);
+	}
+
+	template <typename KeyT, typename ValueT, typename Resolver>
+	void relink_set(bitmap_set_container<KeyT, ValueT> & c, ValueT * base, Resolver) {c.rebase(base);};
+
+	// where the elements of a container are. This changes whenever they may
+	// have moved: a vector that reallocates, or any insertion or erasure in
+	// a flat_map. Node-based containers never move their elements
+	typedef std::pair<const void *, std::size_t> 	storage_state;
+
+	template <typename Container>
+	storage_state storage_state_of(const Container &) {return storage_state(nullptr, 0);};
+
+	template <typename T, typename Alloc>
+	storage_state storage_state_of(const std::vector<T, Alloc> & v) {return storage_state(v.data(), 0);};
+
+	template <typename KeyT, typename ValueT, typename Compare>
+	storage_state storage_state_of(const flat_map<KeyT, ValueT, Compare> & m) {return storage_state(m.data().data(), m.generation());};
+} // end namespace Detail
+
+
+
+
+
 // MultiSetContainer is a mapped container type that organizes its elements into sets.
 //* 	Each key-value pair could possibly be in multiple sets (i.e. the intersection
 //* 	of two sets can be nonzero). 
@@ -409,8 +872,26 @@ public:
 //* 	Furthermore, iteration through the available SetType values can be done
 //* 	via the ::set_enumerator type
 //*
+//* 	The SetContainer policy decides how each set stores its members: set_container
+//* 	(a hash map, the default), sorted_set_container (sorted contiguous arrays with
+//* 	random access iteration) or bitmap_set_container (a compressed bitmap, for
+//* 	vector containers with dense integer keys)
+//*
+//* 	The SetRegistry holds the sets by SetType. It is std::map by default, or
+//* 	flat_map (FlatMap.hpp), which keeps the sets contiguous. Creating a set in a
+//* 	flat registry moves the other sets, so references from set(s) must not be
+//* 	kept while new sets are added
+//*
+//* 	Sets point at their elements. When inserting into the container moves its
+//* 	elements (a flat_map, or a vector that reallocates), the sets follow them
+//* 	by key the next time they are used through set(s) or changed, so a set
+//* 	reference must be fetched again with set(s) after inserting. Elements must
+//* 	be removed from their sets before they are erased
+//*
 //***********************************************************/
-template <typename SetType, typename Derived>
+template <typename SetType, typename Derived,
+		  template <typename, typename> class SetContainer = set_container,
+		  template <typename...> class SetRegistry = std::map>
 struct MultiSetContainer : public Derived{
 public:
 
@@ -421,15 +902,20 @@ private:
 	typedef Derived 												container_type;
 	typedef typename container_value_type<container_type>::type 	value_type;
 	typedef typename key_type<value_type>::type 					key_type;
-	typedef set_container<key_type, value_type>						set_container_type;
+	typedef SetContainer<key_type, value_type>						set_container_type;
 
 
-	typedef std::unordered_multimap<key_type, set_type> 			multimap_type;		// this manages the subdomains for every key
-	typedef std::map<set_type, set_container_type>					set_map_type;		// this maps from a set_type to a set_container
+	typedef Detail::MembershipIndex<key_type, !is_pair<value_type>::value> 	membership_type;	// this manages the sets of every key
+	typedef SetRegistry<set_type, set_container_type>				set_map_type;		// this maps from a set_type to a set_container
+	typedef SetRegistry<set_type, unsigned int> 					set_id_map_type;	// this gives every non-empty set a small id
 
 	// member data
-	multimap_type     				mMultiMap;
+	membership_type 				mMembership;
 	set_map_type 					mSetMap;
+	set_id_map_type 				mSetIds;
+	std::vector<set_type> 			mSetNames;			// set of every id
+	std::vector<unsigned int> 		mFreeIds;			// ids of removed sets, for reuse
+	Detail::storage_state 			mStorage;			// where the sets last found the elements
 
 	Derived & derived() {return *static_cast<Derived *>(this);};
 	const Derived & derived() const {return *static_cast<const Derived *>(this);};
@@ -441,39 +927,342 @@ private:
 	template <typename T = value_type>
 	typename std::enable_if<!is_pair<T>::value, key_type>::type 
 	get_key(const iterator & it) const {return it - derived().begin();};
+
+	// the element with a given key
+	template <typename T = value_type>
+	typename std::enable_if<is_pair<T>::value, iterator>::type 
+	get_iterator(key_type k) {return derived().find(k);};
+
+	template <typename T = value_type>
+	typename std::enable_if<!is_pair<T>::value, iterator>::type 
+	get_iterator(key_type k) {return derived().begin() + k;};
+
+	// the address of element 0 of a vector container (see rebase_set)
+	template <typename T = value_type>
+	typename std::enable_if<is_pair<T>::value, value_type *>::type 
+	element_base() {return nullptr;};
+
+	template <typename T = value_type>
+	typename std::enable_if<!is_pair<T>::value, value_type *>::type 
+	element_base() {return derived().empty() ? nullptr : &derived()[0];};
+
+	// set "s", or an empty set if there is none. Unlike set(s), this never
+	// adds to the registry, which (e.g. with flat_map) may move the other sets
+	const set_container_type & find_set(set_type s) const {
+		static const set_container_type empty_set;
+		auto sit = mSetMap.find(s);
+		return sit == mSetMap.end() ? empty_set : sit->second;
+	}
+
+	// the id of set "s", which is created if the set has none
+	unsigned int set_id(set_type s){
+		auto it = mSetIds.find(s);
+		if (it != mSetIds.end()) return it->second;
+		unsigned int id;
+		if (mFreeIds.empty()){
+			id = mSetNames.size();
+			mSetNames.push_back(s);
+		}
+		else{
+			id = mFreeIds.back();
+			mFreeIds.pop_back();
+			mSetNames[id] = s;
+		}
+		mSetIds.emplace(s, id);
+		return id;
+	}
+
+	// remove an (empty) set along with its id
+	void release_set(typename set_map_type::iterator sit){
+		auto it = mSetIds.find(sit->first);
+		if (it != mSetIds.end()){
+			mFreeIds.push_back(it->second);
+			mSetIds.erase(it);
+		}
+		mSetMap.erase(sit);
+	}
+
+	// point the sets at the elements again if these have moved since
+	void sync_sets(){
+		if (Detail::storage_state_of(derived()) != mStorage) refresh_sets();
+	}
+
+	// clear the bit of set "id" for a key. Returns false if the
+	// key is not in the set
+	bool erase_membership(key_type k, unsigned int id) {return mMembership.reset(k, id);};
+
+	// add (key, element) items to set "s" in one pass. Given a team, its
+	// threads update the membership of disjoint key ranges, where the
+	// membership index allows it
+	void add_items_to_set(std::vector<std::pair<key_type, value_type *>> & items, set_type s, OmpTeam * team = nullptr){
+		typedef std::pair<key_type, value_type *> item_type;
+		auto by_key = [](const item_type & a, const item_type & b){return a.first < b.first;};
+		auto same_key = [](const item_type & a, const item_type & b){return a.first == b.first;};
+		if (!std::is_sorted(items.begin(), items.end(), by_key)) std::sort(items.begin(), items.end(), by_key);
+		items.erase(std::unique(items.begin(), items.end(), same_key), items.end());
+
+		// keep only the keys that are not in the set yet
+		sync_sets();
+		const unsigned int id = set_id(s);
+		if (!items.empty()) mMembership.reserve(items.back().first, items.size());
+		if (team != nullptr && team->num_threads() > 1 && mMembership.concurrent_set(id)){
+			// each thread compacts its own slice, and the slices are then
+			// moved together
+			const int nthreads = team->num_threads();
+			const std::size_t n = items.size();
+			std::vector<std::size_t> kept(nthreads, 0);
+			team->run([&](int tid){
+				IndexRange r = static_partition(n, tid, nthreads);
+				std::size_t out = r.first;
+				for (std::size_t i=r.first; i<r.last; i++) if (mMembership.set(items[i].first, id)) items[out++] = items[i];
+				kept[tid] = out - r.first;
+			});
+			std::size_t out = 0;
+			for (int t=0; t<nthreads; t++){
+				IndexRange r = static_partition(n, t, nthreads);
+				std::move(items.begin()+r.first, items.begin()+r.first+kept[t], items.begin()+out);
+				out += kept[t];
+			}
+			items.resize(out);
+		}
+		else{
+			items.erase(std::remove_if(items.begin(), items.end(), [this, id](const item_type & i){return !mMembership.set(i.first, id);}), items.end());
+		}
+
+		auto sit = mSetMap.emplace(s, set_container_type()).first;
+		sit->second.insert_bulk(items);
+		Detail::rebase_set(sit->second, element_base());
+		if (sit->second.empty()) release_set(sit);
+	}
+
+	// remove keys from set "s" in one pass
+	void remove_keys_from_set(std::vector<key_type> & keys, set_type s){
+		auto sit = mSetMap.find(s);
+		auto iit = mSetIds.find(s);
+		if (sit == mSetMap.end() || iit == mSetIds.end()) return;
+		const unsigned int id = iit->second;
+		if (!std::is_sorted(keys.begin(), keys.end())) std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+		keys.erase(std::remove_if(keys.begin(), keys.end(), [this, id](key_type k){return !erase_membership(k, id);}), keys.end());
+
+		sit->second.erase_bulk(keys);
+		if (sit->second.empty()) release_set(sit);
+	}
 public:
 
-	set_container_type & set(set_type s){return mSetMap[s];};
+	set_container_type & set(set_type s){
+		sync_sets();
+		set_container_type & c = mSetMap[s];
+		Detail::rebase_set(c, element_base());
+		return c;
+	}
+
+	// the keys of set "s" in ascending order. These are kept by each set
+	// and only re-sorted after out-of-order insertions, so repeated set
+	// algebra is a linear merge. Bitmap sets return a new vector
+	auto sorted_keys(set_type s) const -> decltype(std::declval<const set_container_type &>().sorted_keys()) {
+		return find_set(s).sorted_keys();
+	}
 
 	// add an existing element to a set "s"
 	void  add_to_set(const iterator & it, set_type s){
-		// std::cout << "adding key: " << get_key(it) << " to set " << s << std::endl;
-		mMultiMap.emplace(get_key(it), s);		// create entry in the multimap
-		mSetMap[s].insert(std::make_pair(get_key(it), &(*it)));	// create entry in the set container
-		// mSetMap[s].insert(get_key(it), &(*it));	// create entry in the set container
+		key_type my_key = get_key(it);
+		// set the bit of "s" for this key, and add it to the set container
+		if (mMembership.set(my_key, set_id(s))){
+			sync_sets();
+			set_container_type & c = mSetMap[s];
+			c.insert(my_key, &(*it));
+			Detail::rebase_set(c, element_base());
+		}
 	}
 
-	// remove an existing element from set "s"
+	// remove an existing element from set "s". The membership bit and the
+	// set ids make this independent of how many sets the element is in
 	void remove_from_set(const iterator & it, set_type s){
-		// erase from the multimap
+		auto iit = mSetIds.find(s);
+		if (iit == mSetIds.end()) return;
 		key_type my_key = get_key(it);
-		auto mit = mMultiMap.find(my_key);
-		while (mit->second != s && mit->first == my_key){
-			mit++;
-		}
-		if (mit->second == s && mit->first == my_key){
-			mMultiMap.erase(mit);
+		if (erase_membership(my_key, iit->second)){
 			// erase from set container
-			auto sit = mSetMap[s].find(my_key);
-			mSetMap[s].erase(sit);
+			auto sit = mSetMap.find(s);
+			sit->second.erase(my_key);
 			// remove the set if it is now empty
-			if (mSetMap[s].empty()){
-				auto rit = mSetMap.find(s);
-				mSetMap.erase(rit);
+			if (sit->second.empty()) release_set(sit);
+		}
+	}
+
+	// true if an element is in set "s"
+	bool in_set(const iterator & it, set_type s) const {return in_set(get_key(it), s);};
+
+	bool in_set(key_type k, set_type s) const {
+		auto iit = mSetIds.find(s);
+		if (iit == mSetIds.end()) return false;
+		return mMembership.test(k, iit->second);
+	}
+
+	// the number of sets an element is in
+	std::size_t num_sets_of(const iterator & it) const {
+		return mMembership.count(get_key(it));
+	}
+
+	// the sets an element is in
+	std::vector<set_type> sets_of(const iterator & it) const {
+		std::vector<set_type> out;
+		mMembership.for_each(get_key(it), [this, &out](unsigned int id){out.push_back(mSetNames[id]);});
+		return out;
+	}
+
+
+
+	// the following add or remove many elements at once. Each reserves
+	// once and updates the set in a single pass, which is much cheaper
+	// than calling add_to_set / remove_from_set per element
+
+	// add the elements [beg, end) of this container to set "s"
+	void add_range_to_set(iterator beg, iterator end, set_type s){
+		std::vector<std::pair<key_type, value_type *>> items;
+		for (auto it=beg; it!=end; it++) items.emplace_back(get_key(it), &(*it));
+		add_items_to_set(items, s);
+	}
+
+	// add the elements with the given keys to set "s"
+	void add_range_to_set(const std::vector<key_type> & keys, set_type s){
+		std::vector<std::pair<key_type, value_type *>> items;
+		items.reserve(keys.size());
+		for (auto k=keys.begin(); k!=keys.end(); k++) items.emplace_back(*k, &(*get_iterator(*k)));
+		add_items_to_set(items, s);
+	}
+
+	// remove the elements [beg, end) of this container from set "s"
+	void remove_range_from_set(iterator beg, iterator end, set_type s){
+		std::vector<key_type> keys;
+		for (auto it=beg; it!=end; it++) keys.push_back(get_key(it));
+		remove_keys_from_set(keys, s);
+	}
+
+	// remove the elements with the given keys from set "s"
+	void remove_range_from_set(const std::vector<key_type> & keys, set_type s){
+		std::vector<key_type> k(keys);
+		remove_keys_from_set(k, s);
+	}
+
+	// make set "s" hold exactly the elements [beg, end)
+	void assign_set(set_type s, iterator beg, iterator end){
+		clear_set(s);
+		add_range_to_set(beg, end, s);
+	}
+
+	// make set "s" hold exactly the elements with the given keys
+	void assign_set(set_type s, const std::vector<key_type> & keys){
+		clear_set(s);
+		add_range_to_set(keys, s);
+	}
+
+	// remove every element from set "s"
+	void clear_set(set_type s){
+		auto sit = mSetMap.find(s);
+		if (sit == mSetMap.end()) return;
+		auto iit = mSetIds.find(s);
+		if (iit != mSetIds.end()){
+			const std::vector<key_type> & keys = sit->second.sorted_keys();
+			for (auto k=keys.begin(); k!=keys.end(); k++) erase_membership(*k, iit->second);
+		}
+		release_set(sit);
+	}
+
+	// point every set at the current location of its elements, found by
+	// key. set(s) and the functions that add to sets do this by themselves
+	// when the elements have moved; the membership of every element is
+	// unchanged
+	void refresh_sets(){
+		value_type * base = element_base();
+		for (auto sit=mSetMap.begin(); sit!=mSetMap.end(); sit++){
+			Detail::relink_set(sit->second, base, [this](key_type k){return &(*get_iterator(k));});
+		}
+		mStorage = Detail::storage_state_of(derived());
+	}
+
+	// the following only apply to vector containers, where the key of an
+	// element is its position
+
+	// reorder the elements so that the members of sets[0] come first, then
+	// the remaining members of sets[1], and so on, followed by the elements
+	// in none of the given sets. The relative order within each group is
+	// kept, and the keys of every set are renumbered. Afterwards, iterating
+	// sets[0] (and any set whose members are all in one group) streams through
+	// contiguous memory.
+	//
+	// Element i is the former element perm[i], where perm is returned, so
+	// that arrays kept alongside this container can be permuted to match
+	// with apply_permutation. Existing iterators then refer to other elements
+	//
+	// e.g.:	auto perm = nodes.make_sets_contiguous({"inlet", "wall"});
+	// 			apply_permutation(pressure.begin(), pressure.end(), perm);
+	// 			for (auto & n : nodes.contiguous_range("inlet")) ...
+	template <typename T = value_type>
+	typename std::enable_if<!is_pair<T>::value, std::vector<std::size_t>>::type
+	make_sets_contiguous(const std::vector<set_type> & sets){
+		const std::size_t n = derived().size();
+		std::vector<std::size_t> perm;
+		perm.reserve(n);
+		std::vector<char> placed(n, 0);
+		for (auto s=sets.begin(); s!=sets.end(); s++){
+			auto sit = mSetMap.find(*s);
+			if (sit == mSetMap.end()) continue;
+			const std::vector<key_type> & keys = sit->second.sorted_keys();
+			for (auto k=keys.begin(); k!=keys.end(); k++){
+				if (placed[*k]) continue;
+				placed[*k] = 1;
+				perm.push_back(*k);
 			}
 		}
+		for (std::size_t k=0; k<n; k++) if (!placed[k]) perm.push_back(k);
+
+		apply_permutation(derived().begin(), derived().end(), perm);
+		mMembership.permute(perm);
+
+		// renumber the members of every set
+		std::vector<std::size_t> inv(n);
+		for (std::size_t i=0; i<n; i++) inv[perm[i]] = i;
+		std::vector<std::pair<key_type, value_type *>> items;
+		for (auto sit=mSetMap.begin(); sit!=mSetMap.end(); sit++){
+			const std::vector<key_type> & keys = sit->second.sorted_keys();
+			items.clear();
+			items.reserve(keys.size());
+			for (auto k=keys.begin(); k!=keys.end(); k++) items.emplace_back(key_type(inv[*k]), &derived()[inv[*k]]);
+			std::sort(items.begin(), items.end(), [](const std::pair<key_type, value_type *> & a, const std::pair<key_type, value_type *> & b){return a.first < b.first;});
+			sit->second.clear();
+			sit->second.insert_bulk(items);
+		}
+		mStorage = Detail::storage_state_of(derived());
+		return perm;
+	}
+
+	// the same for a single set
+	template <typename T = value_type>
+	typename std::enable_if<!is_pair<T>::value, std::vector<std::size_t>>::type
+	make_set_contiguous(set_type s) {return make_sets_contiguous(std::vector<set_type>(1, s));};
+
+	// true if the members of set "s" are consecutive elements
+	template <typename T = value_type>
+	typename std::enable_if<!is_pair<T>::value, bool>::type
+	is_contiguous(set_type s){
+		const std::vector<key_type> & keys = sorted_keys(s);
+		return keys.empty() || std::size_t(keys.back() - keys.front()) + 1 == keys.size();
+	}
+
+	// the elements from the first to the last member of set "s", which are
+	// exactly the members if is_contiguous(s)
+	template <typename T = value_type>
+	typename std::enable_if<!is_pair<T>::value, IteratorRange<iterator>>::type
+	contiguous_range(set_type s){
+		const std::vector<key_type> & keys = sorted_keys(s);
+		if (keys.empty()) return make_range(derived().end(), derived().end());
+		return make_range(derived().begin() + keys.front(), derived().begin() + keys.back() + 1);
 	}
 
+
+
 	// set enumerator
 	std::vector<set_type> enumerate_sets() const {
 		std::vector<set_type> out;
@@ -489,83 +1278,207 @@ public:
 	// case of a map container, or an index (integer) in the case of a vector container)
 	// set intersection
 	std::vector<key_type> set_intersection(set_type s1, set_type s2){
-		std::vector<key_type> k1, k2;
-
-		k1.reserve(set(s1).size());
-		k2.reserve(set(s2).size());
-
-		for (auto it = set(s1).begin(); it != set(s1).end(); it++) k1.push_back(it->first);
-		for (auto it = set(s2).begin(); it != set(s2).end(); it++) k2.push_back(it->first);
-
-		std::sort(k1.begin(), k1.end());
-		std::sort(k2.begin(), k2.end());
+		std::vector<key_type> out;
+		set_intersection(s1, s2, out);
+		return out;
+	}
 
+	// set difference
+	std::vector<key_type> set_difference(set_type s1, set_type s2){
 		std::vector<key_type> out;
+		set_difference(s1, s2, out);
+		return out;
+	}
 
-		std::set_intersection(k1.begin(), k1.end(), k2.begin(), k2.end(), std::back_inserter(out));
+	// set union
+	std::vector<key_type> set_union(set_type s1, set_type s2){
+		std::vector<key_type> out;
+		set_union(s1, s2, out);
+		return out;
+	}
 
+	// set xor
+	std::vector<key_type> set_xor(set_type s1, set_type s2){
+		std::vector<key_type> out;
+		set_xor(s1, s2, out);
 		return out;
 	}
 
-	// set difference
-	std::vector<key_type> set_difference(set_type s1, set_type s2){
-		std::vector<key_type> k1, k2;
 
-		k1.reserve(set(s1).size());
-		k2.reserve(set(s2).size());
 
-		for (auto it = set(s1).begin(); it != set(s1).end(); it++) k1.push_back(it->first);
-		for (auto it = set(s2).begin(); it != set(s2).end(); it++) k2.push_back(it->first);
+	/** @class concurrent_inserter
+	 *  @brief adds elements to sets from many threads at once
+	 *
+	 *  Each thread stages its (element, set) pairs in a buffer of
+	 *  its own, so add_to_set takes no lock and can be called from
+	 *  for_each_parallel, a ThreadPool or any other threads. commit()
+	 *  is the sync point: once the threads are done, it sorts the
+	 *  buffers in parallel and merges them into the container with
+	 *  the bulk add of add_range_to_set. For vector containers the
+	 *  membership of disjoint key ranges is updated in parallel too,
+	 *  and only the set container insertion is serial. The destructor
+	 *  commits anything left. The container must not be changed
+	 *  otherwise while elements are staged
+	 *
+	 *  e.g.:	SetVector::concurrent_inserter ins(nodes);
+	 *  		#pragma omp parallel for
+	 *  		for (std::size_t i=0; i<nodes.size(); i++) if (on_wall(nodes[i])) ins.add_to_set(i, "wall");
+	 *  		ins.commit();
+	 */
+	class concurrent_inserter{
+	public:
+		concurrent_inserter(MultiSetContainer & c)
+		: mContainer(c), mId(Detail::next_instance_id()) {};
 
-		std::sort(k1.begin(), k1.end());
-		std::sort(k2.begin(), k2.end());
+		concurrent_inserter(const concurrent_inserter &) = delete;
+		concurrent_inserter & operator=(const concurrent_inserter &) = delete;
 
-		std::vector<key_type> out;
+		~concurrent_inserter() {commit();};
 
-		std::set_difference(k1.begin(), k1.end(), k2.begin(), k2.end(), std::back_inserter(out));
+		// stage an element for set "s". Safe to call concurrently
+		void add_to_set(const iterator & it, const set_type & s){
+			buffer().add(s, item_type(mContainer.get_key(it), &(*it)));
+		}
 
-		return out;
-	}
+		// stage the element with key k for set "s". Safe to call concurrently
+		void add_to_set(key_type k, const set_type & s){
+			buffer().add(s, item_type(k, &(*mContainer.get_iterator(k))));
+		}
 
+		// merge every staged element into the container. This must not
+		// run concurrently with add_to_set
+		void commit(){
+			// the buffers of every set
+			std::map<set_type, std::vector<std::vector<item_type> *>> pieces;
+			for (auto b=mBuffers.begin(); b!=mBuffers.end(); b++){
+				for (auto bs=b->second->sets.begin(); bs!=b->second->sets.end(); bs++){
+					if (!bs->second.empty()) pieces[bs->first].push_back(&bs->second);
+				}
+			}
 
-	// set union
-	std::vector<key_type> set_union(set_type s1, set_type s2){
-		std::vector<key_type> k1, k2;
+			OmpTeam team;
+			const std::size_t nthreads = team.num_threads();
+			std::vector<item_type> items;
+			for (auto ps=pieces.begin(); ps!=pieces.end(); ps++){
+				const std::vector<std::vector<item_type> *> & p = ps->second;
+				const std::size_t np = p.size();
+				std::vector<std::size_t> offset(np+1, 0);
+				for (std::size_t i=0; i<np; i++) offset[i+1] = offset[i] + p[i]->size();
+				items.resize(offset[np]);
+
+				// copy and sort every buffer, then merge neighbouring
+				// buffers in parallel rounds
+				team.run([&](int tid){
+					for (std::size_t i=tid; i<np; i+=nthreads){
+						std::copy(p[i]->begin(), p[i]->end(), items.begin()+offset[i]);
+						std::sort(items.begin()+offset[i], items.begin()+offset[i+1], item_less);
+					}
+				});
+				for (std::size_t w=1; w<np; w*=2){
+					team.run([&](int tid){
+						for (std::size_t i=2*w*tid; i+w<np; i+=2*w*nthreads){
+							std::inplace_merge(items.begin()+offset[i], items.begin()+offset[i+w],
+											   items.begin()+offset[std::min(i+2*w, np)], item_less);
+						}
+					});
+				}
+				mContainer.add_items_to_set(items, ps->first, &team);
+			}
 
-		k1.reserve(set(s1).size());
-		k2.reserve(set(s2).size());
+			for (auto b=mBuffers.begin(); b!=mBuffers.end(); b++) b->second->clear();
+		}
 
-		for (auto it = set(s1).begin(); it != set(s1).end(); it++) k1.push_back(it->first);
-		for (auto it = set(s2).begin(); it != set(s2).end(); it++) k2.push_back(it->first);
+	private:
+		typedef std::pair<key_type, value_type *> 		item_type;
+
+		static bool item_less(const item_type & a, const item_type & b) {return a.first < b.first;};
+
+		// the staged elements of one thread, by set. The last set used is
+		// remembered, since loops tend to add runs of elements to one set
+		struct staging_buffer{
+			std::map<set_type, std::vector<item_type>> 		sets;
+			const set_type * 								last_set;
+			std::vector<item_type> * 						last;
+
+			staging_buffer() : last_set(nullptr), last(nullptr) {};
+
+			void add(const set_type & s, const item_type & i){
+				if (last == nullptr || !(*last_set == s)){
+					auto it = sets.emplace(s, std::vector<item_type>()).first;
+					last_set = &it->first;
+					last = &it->second;
+				}
+				last->push_back(i);
+			}
 
-		std::sort(k1.begin(), k1.end());
-		std::sort(k2.begin(), k2.end());
+			void clear(){
+				sets.clear();
+				last_set = nullptr;
+				last = nullptr;
+			}
+		};
+
+		// the buffer of the calling thread. Each thread remembers its
+		// buffer, and only takes the lock the first time it calls this
+		// (or after using another inserter)
+		staging_buffer & buffer(){
+			static thread_local std::pair<std::size_t, staging_buffer *> cached(0, nullptr);
+			if (cached.first != mId){
+				std::lock_guard<std::mutex> lock(mMutex);
+				std::unique_ptr<staging_buffer> & b = mBuffers[std::this_thread::get_id()];
+				if (!b) b.reset(new staging_buffer());
+				cached = std::make_pair(mId, b.get());
+			}
+			return *cached.second;
+		}
 
-		std::vector<key_type> out;
+		MultiSetContainer & 													mContainer;
+		const std::size_t 														mId;
+		std::mutex 																mMutex;
+		std::map<std::thread::id, std::unique_ptr<staging_buffer>> 				mBuffers;
+	};
 
-		std::set_union(k1.begin(), k1.end(), k2.begin(), k2.end(), std::back_inserter(out));
 
-		return out;
+
+	// set "s" as a term of a lazy set expression (see SetExpression.hpp).
+	// Combined with |, &, - and ^, whole queries are evaluated in a single
+	// merge of the sorted keys of every set, without intermediate vectors.
+	// Bitmap sets are terms over their bitmaps, and an operation between
+	// two of them is evaluated with the bitmap algebra
+	//
+	// e.g.:	auto q = (m.query("inlet") | m.query("wall")) - m.query("corner");
+	// 			for (auto k : q) ...
+	auto query(set_type s) const -> decltype(Detail::set_terminal(std::declval<const set_container_type &>())) {
+		return Detail::set_terminal(find_set(s));
 	}
 
-	// set xor
-	std::vector<key_type> set_xor(set_type s1, set_type s2){
-		std::vector<key_type> k1, k2;
 
-		k1.reserve(set(s1).size());
-		k2.reserve(set(s2).size());
 
-		for (auto it = set(s1).begin(); it != set(s1).end(); it++) k1.push_back(it->first);
-		for (auto it = set(s2).begin(); it != set(s2).end(); it++) k2.push_back(it->first);
+	// the following write the keys of the result into a caller-provided
+	// buffer and return their number. They run the parallel merge of
+	// SetAlgebra.hpp on the sorted keys of each set (or the bitmap algebra
+	// for bitmap sets), and do not allocate once the buffer is large enough
 
-		std::sort(k1.begin(), k1.end());
-		std::sort(k2.begin(), k2.end());
+	// "out" must hold max_result_size(op, set(s1).size(), set(s2).size()) keys
+	std::size_t set_operation(SetOperation op, set_type s1, set_type s2, key_type * out) const {
+		return Detail::set_algebra(op, find_set(s1), find_set(s2), out);
+	}
 
-		std::vector<key_type> out;
+	// "out" is resized to the result
+	std::size_t set_intersection(set_type s1, set_type s2, std::vector<key_type> & out) const {
+		return Detail::set_algebra(SetOperation::INTERSECTION, find_set(s1), find_set(s2), out);
+	}
 
-		std::set_symmetric_difference(k1.begin(), k1.end(), k2.begin(), k2.end(), std::back_inserter(out));
+	std::size_t set_difference(set_type s1, set_type s2, std::vector<key_type> & out) const {
+		return Detail::set_algebra(SetOperation::DIFFERENCE, find_set(s1), find_set(s2), out);
+	}
 
-		return out;
+	std::size_t set_union(set_type s1, set_type s2, std::vector<key_type> & out) const {
+		return Detail::set_algebra(SetOperation::UNION, find_set(s1), find_set(s2), out);
+	}
+
+	std::size_t set_xor(set_type s1, set_type s2, std::vector<key_type> & out) const {
+		return Detail::set_algebra(SetOperation::XOR, find_set(s1), find_set(s2), out);
 	}
 
 };
@@ -582,6 +1495,20 @@ using set_unordered_map = MultiSetContainer<set, std::unordered_map<key, value>>
 template <typename value, typename set>
 using set_vector = MultiSetContainer<set, std::vector<value>>;
 
+template <typename key, typename value, typename set>
+using sorted_set_map = MultiSetContainer<set, std::map<key, value>, sorted_set_container>;
+
+template <typename value, typename set>
+using sorted_set_vector = MultiSetContainer<set, std::vector<value>, sorted_set_container>;
+
+template <typename value, typename set>
+using bitmap_set_vector = MultiSetContainer<set, std::vector<value>, bitmap_set_container>;
+
+// the elements of a flat_map move on every insertion or erasure, and the
+// sets look them up again by key the next time set(s) is called
+template <typename key, typename value, typename set>
+using flat_set_map = MultiSetContainer<set, flat_map<key, value>, sorted_set_container, flat_map>;
+
 
 
 /*
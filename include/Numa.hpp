@@ -0,0 +1,169 @@
+/** @file Numa.hpp
+ *  @brief file with NUMA placement utilities
+ *
+ *  This contains thread affinity control and first-touch
+ *  initialization of arrays, so that pages of mesh-sized
+ *  arrays end up on the socket of the thread that later
+ *  works on them in for_each_parallel
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _NUMA_H
+#define _NUMA_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include <omp.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "WorkStealing.hpp"
+
+namespace simbox{
+
+
+	// pin the calling thread to a single cpu. Returns false if
+	// pinning is not supported or failed
+	inline bool pin_this_thread(int cpu){
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu % CPU_SETSIZE, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+
+
+	// how threads are placed on cpus
+	//
+	// NONE 	- leave placement to the operating system
+	// COMPACT 	- thread t on cpu t, filling one socket before the next
+	// SCATTER 	- threads spread evenly over all cpus, so that a team smaller
+	// 			  than the machine still uses every socket's memory bandwidth
+	enum class Affinity : unsigned int {NONE=0, COMPACT, SCATTER};
+
+	// the cpu that thread "tid" of "nthreads" is pinned to
+	inline int affinity_cpu(Affinity a, int tid, int nthreads){
+		int ncpu = std::max<int>(1, std::thread::hardware_concurrency());
+		if (a == Affinity::SCATTER && nthreads < ncpu) return (tid*ncpu/nthreads) % ncpu;
+		return tid % ncpu;
+	}
+
+	// pin every thread of a team (OmpTeam, ThreadPool, ...) according
+	// to the affinity. Pinning omp threads only sticks if the runtime
+	// keeps its thread team alive between parallel regions, which is
+	// the case for the common runtimes
+	template <typename Team>
+	void set_thread_affinity(Team & team, Affinity a){
+		if (a == Affinity::NONE) return;
+		const int nthreads = team.num_threads();
+		team.run([a, nthreads](int tid){
+			pin_this_thread(affinity_cpu(a, tid, nthreads));
+		});
+	}
+
+	inline void set_thread_affinity(Affinity a){
+		OmpTeam team;
+		set_thread_affinity(team, a);
+	}
+
+
+
+	// allocator that default-initializes instead of value-initializing.
+	// For trivial types this means resize() does not write to the new
+	// memory, so no page is touched until first_touch() does it in parallel
+	template <typename T, typename BaseAllocator = std::allocator<T>>
+	struct default_init_allocator : public BaseAllocator{
+		typedef std::allocator_traits<BaseAllocator> 	base_traits;
+
+		template <typename U>
+		struct rebind{
+			typedef default_init_allocator<U, typename base_traits::template rebind_alloc<U>> other;
+		};
+
+		using BaseAllocator::BaseAllocator;
+
+		default_init_allocator() {};
+
+		template <typename U, typename B>
+		default_init_allocator(const default_init_allocator<U, B> & a)
+		: BaseAllocator(a) {};
+
+		template <typename U>
+		void construct(U * p) {::new(static_cast<void *>(p)) U;};
+
+		template <typename U, typename... Args>
+		void construct(U * p, Args && ... a) {
+			base_traits::construct(static_cast<BaseAllocator &>(*this), p, std::forward<Args>(a)...);
+		};
+	};
+
+	// a vector whose pages are placed by first_touch rather than by resize
+	template <typename T>
+	using first_touch_vector = std::vector<T, default_init_allocator<T>>;
+
+
+
+	// write g(i) to element i of the random access range [beg, end), with
+	// each thread of the team writing its static_partition slice. This is the
+	// slice a thread starts from in for_each_parallel with the same team, so
+	// the pages it touches first end up in its socket's memory
+	//
+	// e.g.:	first_touch_vector<double> v; v.resize(n);
+	// 			first_touch(v.begin(), v.end(), [](std::size_t i){return 0.0;});
+	template <typename Team, typename IteratorType, typename Generator>
+	void first_touch(Team & team, IteratorType beg, IteratorType end, Generator g){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_same<category, std::random_access_iterator_tag>::value, "Must be a random access iterator to first-touch!");
+
+		const std::size_t n = end - beg;
+		const int nthreads = team.num_threads();
+		team.run([&](int tid){
+			IndexRange r = static_partition(n, tid, nthreads);
+			for (std::size_t i=r.first; i<r.last; i++) *(beg+i) = g(i);
+		});
+	}
+
+	template <typename IteratorType, typename Generator>
+	void first_touch(IteratorType beg, IteratorType end, Generator g){
+		OmpTeam team;
+		first_touch(team, beg, end, g);
+	}
+
+	// resize a first_touch_vector to n elements and touch the new pages
+	// with "value" in parallel. The slices are those of the whole vector,
+	// so each thread writes the new elements that for_each_parallel gives it
+	template <typename Team, typename T>
+	void first_touch_resize(Team & team, first_touch_vector<T> & v, std::size_t n, const T & value = T()){
+		const std::size_t old = v.size();
+		v.resize(n);
+		if (n <= old) return;
+		const int nthreads = team.num_threads();
+		team.run([&](int tid){
+			IndexRange r = static_partition(n, tid, nthreads);
+			for (std::size_t i=std::max(r.first, old); i<r.last; i++) v[i] = value;
+		});
+	}
+
+	template <typename T>
+	void first_touch_resize(first_touch_vector<T> & v, std::size_t n, const T & value = T()){
+		OmpTeam team;
+		first_touch_resize(team, v, n, value);
+	}
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,528 @@
+/** @file Range.hpp
+ *  @brief file with lazy range adaptors
+ *
+ *  This contains IteratorRange and the lazy adaptors in
+ *  simbox::view (filter, transform, stride, chunk, enumerate),
+ *  which wrap iterators instead of copying elements. They
+ *  compose with each other, with ZipIterator and set_container
+ *  ranges, and the resulting begin()/end() can be handed to
+ *  the for_each family
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _RANGE_H
+#define _RANGE_H
+
+#include <new>
+#include <utility>
+#include <stdexcept>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+namespace simbox{
+
+
+	namespace Detail{
+		// holds a functor (e.g. a lambda) and makes it copy-assignable, so
+		// that iterators holding it are assignable
+		template <typename Functor>
+		class FunctorBox{
+		public:
+			FunctorBox(const Functor & f) {new (&mStore) Functor(f);};
+			FunctorBox(const FunctorBox & b) {new (&mStore) Functor(b.get());};
+			~FunctorBox() {get().~Functor();};
+
+			FunctorBox & operator=(const FunctorBox & b){
+				if (this != &b){
+					get().~Functor();
+					new (&mStore) Functor(b.get());
+				}
+				return *this;
+			}
+
+			const Functor & get() const {return *reinterpret_cast<const Functor *>(&mStore);};
+			Functor & get() {return *reinterpret_cast<Functor *>(&mStore);};
+
+		private:
+			typename std::aligned_storage<sizeof(Functor), alignof(Functor)>::type mStore;
+		};
+
+
+		// advance "it" by up to n, without passing "end"
+		template <typename IteratorType>
+		void advance_bounded(IteratorType & it, const IteratorType & end, std::ptrdiff_t n, std::random_access_iterator_tag){
+			it += std::min<std::ptrdiff_t>(n, end - it);
+		}
+
+		template <typename IteratorType>
+		void advance_bounded(IteratorType & it, const IteratorType & end, std::ptrdiff_t n, std::input_iterator_tag){
+			for (std::ptrdiff_t i=0; i<n && it!=end; i++) ++it;
+		}
+
+		template <typename IteratorType>
+		void advance_bounded(IteratorType & it, const IteratorType & end, std::ptrdiff_t n){
+			typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+			advance_bounded(it, end, n, category());
+		}
+
+
+		// the category of an adaptor that can at most go forward
+		template <typename IteratorType>
+		struct forward_category{
+			typedef typename std::iterator_traits<IteratorType>::iterator_category 	category;
+			typedef typename std::conditional<std::is_base_of<std::forward_iterator_tag, category>::value,
+											  std::forward_iterator_tag, category>::type type;
+		};
+	} // end namespace Detail
+
+
+
+
+	/** @class IteratorRange
+	 *  @brief a pair of iterators that can be used as a range
+	 *
+	 */
+	template <typename IteratorType>
+	class IteratorRange{
+	public:
+		typedef IteratorType 												iterator;
+		typedef IteratorType 												const_iterator;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+
+		IteratorRange(IteratorType beg, IteratorType end)
+		: mBeg(beg), mEnd(end) {};
+
+		IteratorType begin() const {return mBeg;};
+		IteratorType end() const {return mEnd;};
+
+		bool empty() const {return mBeg == mEnd;};
+
+		// number of elements. This walks the range unless the
+		// iterators are random access
+		std::size_t size() const {return std::distance(mBeg, mEnd);};
+
+	private:
+		IteratorType 		mBeg, mEnd;
+	};
+
+	template <typename IteratorType>
+	IteratorRange<IteratorType> make_range(IteratorType beg, IteratorType end){
+		return IteratorRange<IteratorType>(beg, end);
+	}
+
+
+
+
+	/** @class FilterIterator
+	 *  @brief iterator that skips the elements that fail a predicate
+	 *
+	 */
+	template <typename IteratorType, typename Predicate>
+	class FilterIterator{
+	public:
+		typedef FilterIterator 													self_type;
+		typedef typename std::iterator_traits<IteratorType>::value_type 		value_type;
+		typedef typename std::iterator_traits<IteratorType>::reference 			reference;
+		typedef typename std::iterator_traits<IteratorType>::pointer 			pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef typename Detail::forward_category<IteratorType>::type 			iterator_category;
+
+		FilterIterator(IteratorType it, IteratorType end, Predicate p)
+		: mIt(it), mEnd(end), mPred(p) {satisfy();};
+
+		reference operator*() const {return *mIt;};
+
+		// the underlying iterator
+		const IteratorType & base() const {return mIt;};
+
+		self_type & operator++(){
+			++mIt;
+			satisfy();
+			return *this;
+		};
+
+		self_type operator++(int blah){
+			self_type out(*this);
+			++(*this);
+			return out;
+		};
+
+		bool operator!=(const self_type & it) const {return mIt != it.mIt;};
+		bool operator==(const self_type & it) const {return mIt == it.mIt;};
+
+	private:
+		// move forward to the next element that passes
+		void satisfy(){
+			while (mIt != mEnd && !mPred.get()(*mIt)) ++mIt;
+		}
+
+		IteratorType 						mIt, mEnd;
+		Detail::FunctorBox<Predicate> 		mPred;
+	};
+
+
+
+
+	/** @class TransformIterator
+	 *  @brief iterator that dereferences to a function of the underlying element
+	 *
+	 *  The function is called on every dereference. The category is the
+	 *  one of the underlying iterator, so a transformed random access
+	 *  range still runs in parallel
+	 *
+	 */
+	template <typename IteratorType, typename Function>
+	class TransformIterator{
+	public:
+		typedef TransformIterator 												self_type;
+		typedef decltype(std::declval<const Function &>()(*std::declval<IteratorType>())) 	reference;
+		typedef typename std::decay<reference>::type 							value_type;
+		typedef value_type * 													pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef typename std::iterator_traits<IteratorType>::iterator_category 	iterator_category;
+
+		TransformIterator(IteratorType it, Function f)
+		: mIt(it), mFunc(f) {};
+
+		reference operator*() const {return mFunc.get()(*mIt);};
+		reference operator[](difference_type n) const {return mFunc.get()(*(mIt + n));};
+
+		// the underlying iterator
+		const IteratorType & base() const {return mIt;};
+
+		self_type & operator++() {++mIt; return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++mIt; return out;};
+		self_type & operator--() {--mIt; return *this;};
+		self_type operator--(int blah) {self_type out(*this); --mIt; return out;};
+
+		self_type & operator+=(difference_type n) {mIt += n; return *this;};
+		self_type & operator-=(difference_type n) {mIt -= n; return *this;};
+		self_type operator+(difference_type n) const {self_type out(*this); return out += n;};
+		self_type operator-(difference_type n) const {self_type out(*this); return out -= n;};
+		difference_type operator-(const self_type & it) const {return mIt - it.mIt;};
+
+		bool operator!=(const self_type & it) const {return mIt != it.mIt;};
+		bool operator==(const self_type & it) const {return mIt == it.mIt;};
+		bool operator<(const self_type & it) const {return mIt < it.mIt;};
+		bool operator>(const self_type & it) const {return it.mIt < mIt;};
+		bool operator<=(const self_type & it) const {return !(it.mIt < mIt);};
+		bool operator>=(const self_type & it) const {return !(mIt < it.mIt);};
+
+	private:
+		IteratorType 						mIt;
+		Detail::FunctorBox<Function> 		mFunc;
+	};
+
+
+
+
+	/** @class EnumerateIterator
+	 *  @brief iterator that dereferences to a (position, element) pair
+	 *
+	 */
+	template <typename IteratorType>
+	class EnumerateIterator{
+	public:
+		typedef EnumerateIterator 												self_type;
+		typedef typename std::iterator_traits<IteratorType>::reference 			base_reference;
+		typedef std::pair<std::size_t, base_reference> 							reference;
+		typedef std::pair<std::size_t, typename std::iterator_traits<IteratorType>::value_type> 	value_type;
+		typedef reference * 													pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef typename std::iterator_traits<IteratorType>::iterator_category 	iterator_category;
+
+		EnumerateIterator(IteratorType it, std::size_t i)
+		: mIt(it), mIndex(i) {};
+
+		reference operator*() const {return reference(mIndex, *mIt);};
+		reference operator[](difference_type n) const {return reference(mIndex + n, *(mIt + n));};
+
+		// the underlying iterator
+		const IteratorType & base() const {return mIt;};
+		std::size_t index() const {return mIndex;};
+
+		self_type & operator++() {++mIt; ++mIndex; return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++(*this); return out;};
+		self_type & operator--() {--mIt; --mIndex; return *this;};
+		self_type operator--(int blah) {self_type out(*this); --(*this); return out;};
+
+		self_type & operator+=(difference_type n) {mIt += n; mIndex += n; return *this;};
+		self_type & operator-=(difference_type n) {mIt -= n; mIndex -= n; return *this;};
+		self_type operator+(difference_type n) const {self_type out(*this); return out += n;};
+		self_type operator-(difference_type n) const {self_type out(*this); return out -= n;};
+		difference_type operator-(const self_type & it) const {return difference_type(mIndex) - difference_type(it.mIndex);};
+
+		bool operator!=(const self_type & it) const {return mIt != it.mIt;};
+		bool operator==(const self_type & it) const {return mIt == it.mIt;};
+		bool operator<(const self_type & it) const {return mIndex < it.mIndex;};
+		bool operator>(const self_type & it) const {return it.mIndex < mIndex;};
+		bool operator<=(const self_type & it) const {return !(it.mIndex < mIndex);};
+		bool operator>=(const self_type & it) const {return !(mIndex < it.mIndex);};
+
+	private:
+		IteratorType 		mIt;
+		std::size_t 		mIndex;
+	};
+
+
+
+
+	/** @class StrideIterator
+	 *  @brief iterator over every n-th element of a range
+	 *
+	 *  Random access ranges are strided by index, so the strided
+	 *  range is random access as well. Other ranges step forward
+	 *  n elements at a time without passing the end
+	 *
+	 */
+	template <typename IteratorType,
+			  typename Category = typename std::iterator_traits<IteratorType>::iterator_category>
+	class StrideIterator{
+	public:
+		typedef StrideIterator 													self_type;
+		typedef typename std::iterator_traits<IteratorType>::value_type 		value_type;
+		typedef typename std::iterator_traits<IteratorType>::reference 			reference;
+		typedef typename std::iterator_traits<IteratorType>::pointer 			pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef typename Detail::forward_category<IteratorType>::type 			iterator_category;
+
+		StrideIterator(IteratorType it, IteratorType end, std::size_t stride)
+		: mIt(it), mEnd(end), mStride(stride) {};
+
+		reference operator*() const {return *mIt;};
+
+		const IteratorType & base() const {return mIt;};
+
+		self_type & operator++() {Detail::advance_bounded(mIt, mEnd, mStride); return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++(*this); return out;};
+
+		bool operator!=(const self_type & it) const {return mIt != it.mIt;};
+		bool operator==(const self_type & it) const {return mIt == it.mIt;};
+
+	private:
+		IteratorType 		mIt, mEnd;
+		std::size_t 		mStride;
+	};
+
+	template <typename IteratorType>
+	class StrideIterator<IteratorType, std::random_access_iterator_tag>{
+	public:
+		typedef StrideIterator 													self_type;
+		typedef typename std::iterator_traits<IteratorType>::value_type 		value_type;
+		typedef typename std::iterator_traits<IteratorType>::reference 			reference;
+		typedef typename std::iterator_traits<IteratorType>::pointer 			pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef std::random_access_iterator_tag 								iterator_category;
+
+		// the i-th strided element after beg
+		StrideIterator(IteratorType beg, std::size_t i, std::size_t stride)
+		: mBeg(beg), mIndex(i), mStride(stride) {};
+
+		reference operator*() const {return *(mBeg + mIndex*mStride);};
+		reference operator[](difference_type n) const {return *(mBeg + (mIndex + n)*mStride);};
+
+		IteratorType base() const {return mBeg + mIndex*mStride;};
+
+		self_type & operator++() {++mIndex; return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++mIndex; return out;};
+		self_type & operator--() {--mIndex; return *this;};
+		self_type operator--(int blah) {self_type out(*this); --mIndex; return out;};
+
+		self_type & operator+=(difference_type n) {mIndex += n; return *this;};
+		self_type & operator-=(difference_type n) {mIndex -= n; return *this;};
+		self_type operator+(difference_type n) const {self_type out(*this); return out += n;};
+		self_type operator-(difference_type n) const {self_type out(*this); return out -= n;};
+		difference_type operator-(const self_type & it) const {return difference_type(mIndex) - difference_type(it.mIndex);};
+
+		bool operator!=(const self_type & it) const {return mIndex != it.mIndex;};
+		bool operator==(const self_type & it) const {return mIndex == it.mIndex;};
+		bool operator<(const self_type & it) const {return mIndex < it.mIndex;};
+		bool operator>(const self_type & it) const {return it.mIndex < mIndex;};
+		bool operator<=(const self_type & it) const {return !(it.mIndex < mIndex);};
+		bool operator>=(const self_type & it) const {return !(mIndex < it.mIndex);};
+
+	private:
+		IteratorType 		mBeg;
+		std::size_t 		mIndex;
+		std::size_t 		mStride;
+	};
+
+
+
+
+	/** @class ChunkIterator
+	 *  @brief iterator over consecutive sub-ranges of n elements
+	 *
+	 *  Dereferences to an IteratorRange over the underlying iterators.
+	 *  The last chunk may be shorter
+	 *
+	 */
+	template <typename IteratorType,
+			  typename Category = typename std::iterator_traits<IteratorType>::iterator_category>
+	class ChunkIterator{
+	public:
+		typedef ChunkIterator 													self_type;
+		typedef IteratorRange<IteratorType> 									value_type;
+		typedef value_type 														reference;
+		typedef value_type * 													pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef typename Detail::forward_category<IteratorType>::type 			iterator_category;
+
+		ChunkIterator(IteratorType it, IteratorType end, std::size_t chunk)
+		: mIt(it), mEnd(end), mChunk(chunk) {};
+
+		reference operator*() const {
+			IteratorType last = mIt;
+			Detail::advance_bounded(last, mEnd, mChunk);
+			return reference(mIt, last);
+		};
+
+		self_type & operator++() {Detail::advance_bounded(mIt, mEnd, mChunk); return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++(*this); return out;};
+
+		bool operator!=(const self_type & it) const {return mIt != it.mIt;};
+		bool operator==(const self_type & it) const {return mIt == it.mIt;};
+
+	private:
+		IteratorType 		mIt, mEnd;
+		std::size_t 		mChunk;
+	};
+
+	template <typename IteratorType>
+	class ChunkIterator<IteratorType, std::random_access_iterator_tag>{
+	public:
+		typedef ChunkIterator 													self_type;
+		typedef IteratorRange<IteratorType> 									value_type;
+		typedef value_type 														reference;
+		typedef value_type * 													pointer;
+		typedef typename std::iterator_traits<IteratorType>::difference_type 	difference_type;
+		typedef std::random_access_iterator_tag 								iterator_category;
+
+		// the i-th chunk of [beg, beg+size)
+		ChunkIterator(IteratorType beg, std::size_t size, std::size_t i, std::size_t chunk)
+		: mBeg(beg), mSize(size), mIndex(i), mChunk(chunk) {};
+
+		reference operator*() const {return chunk(mIndex);};
+		reference operator[](difference_type n) const {return chunk(mIndex + n);};
+
+		self_type & operator++() {++mIndex; return *this;};
+		self_type operator++(int blah) {self_type out(*this); ++mIndex; return out;};
+		self_type & operator--() {--mIndex; return *this;};
+		self_type operator--(int blah) {self_type out(*this); --mIndex; return out;};
+
+		self_type & operator+=(difference_type n) {mIndex += n; return *this;};
+		self_type & operator-=(difference_type n) {mIndex -= n; return *this;};
+		self_type operator+(difference_type n) const {self_type out(*this); return out += n;};
+		self_type operator-(difference_type n) const {self_type out(*this); return out -= n;};
+		difference_type operator-(const self_type & it) const {return difference_type(mIndex) - difference_type(it.mIndex);};
+
+		bool operator!=(const self_type & it) const {return mIndex != it.mIndex;};
+		bool operator==(const self_type & it) const {return mIndex == it.mIndex;};
+		bool operator<(const self_type & it) const {return mIndex < it.mIndex;};
+		bool operator>(const self_type & it) const {return it.mIndex < mIndex;};
+		bool operator<=(const self_type & it) const {return !(it.mIndex < mIndex);};
+		bool operator>=(const self_type & it) const {return !(mIndex < it.mIndex);};
+
+	private:
+		reference chunk(std::size_t i) const {
+			return reference(mBeg + std::min(mSize, i*mChunk), mBeg + std::min(mSize, (i+1)*mChunk));
+		}
+
+		IteratorType 		mBeg;
+		std::size_t 		mSize;
+		std::size_t 		mIndex;
+		std::size_t 		mChunk;
+	};
+
+
+
+
+	// lazy views of a range (anything with begin() and end(), including
+	// containers, set_container, IteratorRange and other views). Views only
+	// hold iterators, so the underlying container must outlive them
+	//
+	// e.g.:	auto hot = view::filter(mesh.set(BOUNDARY), [](const Node & n){return n.value > thresh;});
+	// 			for_each<MyPolicy>(hot.begin(), hot.end(), Flag());
+	namespace view{
+
+		// every element of the range
+		template <typename RangeType>
+		auto all(RangeType && r){
+			return make_range(r.begin(), r.end());
+		}
+
+		// the elements for which p(element) is true
+		template <typename RangeType, typename Predicate>
+		auto filter(RangeType && r, Predicate p){
+			typedef FilterIterator<decltype(r.begin()), Predicate> 	iterator;
+			return make_range(iterator(r.begin(), r.end(), p), iterator(r.end(), r.end(), p));
+		}
+
+		// f(element) for every element
+		template <typename RangeType, typename Function>
+		auto transform(RangeType && r, Function f){
+			typedef TransformIterator<decltype(r.begin()), Function> 	iterator;
+			return make_range(iterator(r.begin(), f), iterator(r.end(), f));
+		}
+
+		// (position, element) pairs, with positions counted from 0
+		template <typename RangeType>
+		auto enumerate(RangeType && r){
+			typedef EnumerateIterator<decltype(r.begin())> 	iterator;
+			return make_range(iterator(r.begin(), 0), iterator(r.end(), std::distance(r.begin(), r.end())));
+		}
+
+		namespace Detail{
+			template <typename IteratorType>
+			IteratorRange<StrideIterator<IteratorType>> stride(IteratorType beg, IteratorType end, std::size_t n, std::random_access_iterator_tag){
+				typedef StrideIterator<IteratorType> 	iterator;
+				std::size_t size = end - beg;
+				return make_range(iterator(beg, 0, n), iterator(beg, (size + n - 1)/n, n));
+			}
+
+			template <typename IteratorType>
+			IteratorRange<StrideIterator<IteratorType>> stride(IteratorType beg, IteratorType end, std::size_t n, std::input_iterator_tag){
+				typedef StrideIterator<IteratorType> 	iterator;
+				return make_range(iterator(beg, end, n), iterator(end, end, n));
+			}
+
+			template <typename IteratorType>
+			IteratorRange<ChunkIterator<IteratorType>> chunk(IteratorType beg, IteratorType end, std::size_t n, std::random_access_iterator_tag){
+				typedef ChunkIterator<IteratorType> 	iterator;
+				std::size_t size = end - beg;
+				return make_range(iterator(beg, size, 0, n), iterator(beg, size, (size + n - 1)/n, n));
+			}
+
+			template <typename IteratorType>
+			IteratorRange<ChunkIterator<IteratorType>> chunk(IteratorType beg, IteratorType end, std::size_t n, std::input_iterator_tag){
+				typedef ChunkIterator<IteratorType> 	iterator;
+				return make_range(iterator(beg, end, n), iterator(end, end, n));
+			}
+		} // end namespace Detail
+
+		// every n-th element, starting with the first. A stride of 0
+		// throws std::invalid_argument
+		template <typename RangeType>
+		auto stride(RangeType && r, std::size_t n){
+			if (n == 0) throw std::invalid_argument("view::stride: stride must be positive");
+			typedef typename std::iterator_traits<decltype(r.begin())>::iterator_category category;
+			return Detail::stride(r.begin(), r.end(), n, category());
+		}
+
+		// consecutive sub-ranges of n elements. A chunk size of 0
+		// throws std::invalid_argument
+		template <typename RangeType>
+		auto chunk(RangeType && r, std::size_t n){
+			if (n == 0) throw std::invalid_argument("view::chunk: chunk size must be positive");
+			typedef typename std::iterator_traits<decltype(r.begin())>::iterator_category category;
+			return Detail::chunk(r.begin(), r.end(), n, category());
+		}
+
+	} // end namespace view
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,182 @@
+/** @file Reduce.hpp
+ *  @brief file with parallel reductions
+ *
+ *  This contains reduce_parallel and transform_reduce_parallel,
+ *  the reduction companions to for_each_parallel
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _REDUCE_H
+#define _REDUCE_H
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include <omp.h>
+
+#include "WorkStealing.hpp"
+
+namespace simbox{
+
+
+	// tag that asks for a bitwise reproducible reduction. The range is cut
+	// into blocks of a fixed size, each block is reduced left to right, and
+	// the block results are combined in a fixed pairwise tree. None of this
+	// depends on the number of threads
+	struct Deterministic{
+		std::size_t 	block;
+
+		constexpr Deterministic(std::size_t b = 1024)
+		: block(b) {};
+	};
+	constexpr Deterministic deterministic{};
+
+
+
+	namespace Detail{
+		// iterators to the start of every block of "block" elements, followed by end
+		template <class IteratorType>
+		std::vector<IteratorType> block_starts(std::random_access_iterator_tag, IteratorType beg, IteratorType end, std::size_t block){
+			std::size_t size = end - beg;
+			std::vector<IteratorType> starts;
+			starts.reserve(size/block + 2);
+			for (std::size_t i=0; i<size; i+=block) starts.push_back(beg+i);
+			starts.push_back(end);
+			return starts;
+		}
+
+		template <class IteratorType>
+		std::vector<IteratorType> block_starts(std::forward_iterator_tag, IteratorType beg, IteratorType end, std::size_t block){
+			std::vector<IteratorType> starts;
+			std::size_t ct = 0;
+			for (auto it=beg; it!=end; it++, ct++){
+				if (ct % block == 0) starts.push_back(it);
+			}
+			starts.push_back(end);
+			return starts;
+		}
+
+		// reduce every block left to right, in parallel. Returns one partial
+		// result per block, in block order
+		template <class InterfacePolicy,
+				  class IteratorType,
+				  class T,
+				  class BinaryOp,
+				  class UnaryOp>
+		std::vector<T> reduce_blocks(const std::vector<IteratorType> & starts, const T & init, BinaryOp & combine, UnaryOp & transform){
+			std::vector<T> partial(starts.size()-1, init);
+			WorkStealingExecutor ex(1);
+			ex.run(partial.size(), [&](std::size_t first, std::size_t last){
+				for (std::size_t b=first; b<last; b++){
+					auto it = starts[b];
+					T acc = transform(InterfacePolicy::get(*it));
+					for (it++; it!=starts[b+1]; it++){
+						acc = combine(acc, transform(InterfacePolicy::get(*it)));
+					}
+					partial[b] = acc;
+				}
+			});
+			return partial;
+		}
+
+		template <class InterfacePolicy,
+				  class IteratorType,
+				  class T,
+				  class BinaryOp,
+				  class UnaryOp>
+		T transform_reduce_parallel(IteratorType beg, IteratorType end, T init, BinaryOp & combine, UnaryOp & transform, std::size_t block, bool tree){
+			typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+			static_assert(std::is_base_of<std::forward_iterator_tag, category>::value, "Must be a forward iterator to parallelize!");
+			if (beg == end) return init;
+
+			std::vector<IteratorType> starts = block_starts(category(), beg, end, block);
+			std::vector<T> partial = reduce_blocks<InterfacePolicy>(starts, init, combine, transform);
+
+			if (!tree){
+				for (auto it=partial.begin(); it!=partial.end(); it++) init = combine(init, *it);
+				return init;
+			}
+
+			// fixed pairwise tree over the blocks
+			for (std::size_t stride=1; stride<partial.size(); stride*=2){
+				for (std::size_t i=0; i+stride<partial.size(); i+=2*stride){
+					partial[i] = combine(partial[i], partial[i+stride]);
+				}
+			}
+			return combine(init, partial[0]);
+		}
+
+		// the transform used by plain reductions
+		struct ValueOf{
+			template <typename T>
+			typename std::decay<T>::type operator()(T && t) const {return t;};
+		};
+	} // end namespace Detail
+
+
+
+	// parallel transform-reduce over a general range. Each element is passed
+	// through InterfacePolicy::get, then "transform", and the results are combined
+	// with "combine" together with "init". "combine" must be associative; it
+	// need not be commutative since partial results are always combined in range
+	// order. The grouping of the combinations depends on the number of threads
+	//
+	// e.g.:	double e = transform_reduce_parallel<MyPolicy>(a.begin(), a.end(), 0.0,
+	// 						std::plus<double>(), [](const Node & n){return n.energy();});
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class T,
+			  class BinaryOp,
+			  class UnaryOp>
+	T transform_reduce_parallel(IteratorType beg, IteratorType end, T init, BinaryOp combine, UnaryOp transform){
+		std::size_t size = std::distance(beg, end);
+		std::size_t block = std::max<std::size_t>(1, size/(8*omp_get_max_threads()));
+		return Detail::transform_reduce_parallel<InterfacePolicy>(beg, end, init, combine, transform, block, false);
+	}
+
+	// deterministic parallel transform-reduce. The result is bitwise identical
+	// for any number of threads (see Deterministic)
+	//
+	// e.g.:	double e = transform_reduce_parallel<MyPolicy>(simbox::deterministic, a.begin(), a.end(), 0.0,
+	// 						std::plus<double>(), [](const Node & n){return n.energy();});
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class T,
+			  class BinaryOp,
+			  class UnaryOp>
+	T transform_reduce_parallel(const Deterministic & d, IteratorType beg, IteratorType end, T init, BinaryOp combine, UnaryOp transform){
+		return Detail::transform_reduce_parallel<InterfacePolicy>(beg, end, init, combine, transform, std::max<std::size_t>(1, d.block), true);
+	}
+
+
+
+	// parallel reduction over a general range, combining InterfacePolicy::get
+	// of every element with "combine"
+	//
+	// e.g.:	double s = reduce_parallel<MyPolicy>(a.begin(), a.end(), 0.0, std::plus<double>());
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class T,
+			  class BinaryOp>
+	T reduce_parallel(IteratorType beg, IteratorType end, T init, BinaryOp combine){
+		return transform_reduce_parallel<InterfacePolicy>(beg, end, init, combine, Detail::ValueOf());
+	}
+
+	// deterministic parallel reduction (see Deterministic)
+	//
+	// e.g.:	double s = reduce_parallel<MyPolicy>(simbox::deterministic, a.begin(), a.end(), 0.0, std::plus<double>());
+	template <class InterfacePolicy,
+			  class IteratorType,
+			  class T,
+			  class BinaryOp>
+	T reduce_parallel(const Deterministic & d, IteratorType beg, IteratorType end, T init, BinaryOp combine){
+		return transform_reduce_parallel<InterfacePolicy>(d, beg, end, init, combine, Detail::ValueOf());
+	}
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,441 @@
+/** @file RoaringBitmap.hpp
+ *  @brief file with the RoaringBitmap class
+ *
+ *  This contains RoaringBitmap, a compressed bitmap of
+ *  32-bit integers split into chunks of 65536 values,
+ *  each stored either as a sorted array or as a plain
+ *  bitmap depending on how full it is
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _ROARINGBITMAP_H
+#define _ROARINGBITMAP_H
+
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+namespace simbox{
+
+
+	namespace Detail{
+		inline unsigned int popcount64(std::uint64_t w){
+	#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_popcountll(w);
+	#else
+			unsigned int c = 0;
+			for (; w; c++) w &= w - 1;
+			return c;
+	#endif
+		}
+
+		inline unsigned int ctz64(std::uint64_t w){
+	#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_ctzll(w);
+	#else
+			unsigned int c = 0;
+			while (!(w & 1)) {w >>= 1; c++;}
+			return c;
+	#endif
+		}
+	} // end namespace Detail
+
+
+
+
+	/** @class RoaringBitmap
+	 *  @brief a compressed set of 32-bit unsigned integers
+	 *
+	 *  Values are grouped by their upper 16 bits into chunks. A chunk
+	 *  with at most 4096 values is a sorted array of the lower 16 bits
+	 *  (2 bytes per value), and a fuller chunk is a 65536-bit bitmap
+	 *  (8 kB). Membership tests are a bit test or a short binary search,
+	 *  iteration is in ascending order, and intersection, union,
+	 *  difference and xor of two bitmaps work chunk by chunk, with
+	 *  bitmap chunks combined one 64-bit word at a time
+	 *
+	 */
+	class RoaringBitmap{
+	public:
+		typedef std::uint32_t 			value_type;
+
+	private:
+		static constexpr std::size_t 	max_array = 4096;
+		static constexpr std::size_t 	nwords = 1024;
+
+		struct Chunk{
+			std::uint16_t 					key;		// upper 16 bits
+			std::uint32_t 					card;		// number of values
+			std::vector<std::uint16_t> 		array;		// sorted lower bits, if not a bitmap
+			std::vector<std::uint64_t> 		bits;		// nwords words, if a bitmap
+
+			Chunk(std::uint16_t k = 0) : key(k), card(0) {};
+
+			bool is_bitmap() const {return !bits.empty();};
+
+			bool contains(std::uint16_t low) const {
+				if (is_bitmap()) return (bits[low >> 6] >> (low & 63)) & 1;
+				return std::binary_search(array.begin(), array.end(), low);
+			}
+
+			bool add(std::uint16_t low){
+				if (is_bitmap()){
+					std::uint64_t m = std::uint64_t(1) << (low & 63);
+					if (bits[low >> 6] & m) return false;
+					bits[low >> 6] |= m;
+					card++;
+					return true;
+				}
+				auto it = std::lower_bound(array.begin(), array.end(), low);
+				if (it != array.end() && *it == low) return false;
+				array.insert(it, low);
+				card++;
+				if (card > max_array) to_bitmap();
+				return true;
+			}
+
+			bool remove(std::uint16_t low){
+				if (is_bitmap()){
+					std::uint64_t m = std::uint64_t(1) << (low & 63);
+					if (!(bits[low >> 6] & m)) return false;
+					bits[low >> 6] &= ~m;
+					card--;
+					if (card <= max_array) to_array();
+					return true;
+				}
+				auto it = std::lower_bound(array.begin(), array.end(), low);
+				if (it == array.end() || *it != low) return false;
+				array.erase(it);
+				card--;
+				return true;
+			}
+
+			void to_bitmap(){
+				bits.assign(nwords, 0);
+				for (auto it=array.begin(); it!=array.end(); it++) bits[*it >> 6] |= std::uint64_t(1) << (*it & 63);
+				std::vector<std::uint16_t>().swap(array);
+			}
+
+			void to_array(){
+				array.clear();
+				array.reserve(card);
+				for (std::size_t w=0; w<nwords; w++){
+					for (std::uint64_t word = bits[w]; word; word &= word - 1){
+						array.push_back(std::uint16_t(64*w + Detail::ctz64(word)));
+					}
+				}
+				std::vector<std::uint64_t>().swap(bits);
+			}
+
+			// pick the representation that fits the cardinality
+			void normalize(){
+				if (is_bitmap()){
+					card = 0;
+					for (std::size_t w=0; w<nwords; w++) card += Detail::popcount64(bits[w]);
+					if (card <= max_array) to_array();
+				}
+				else{
+					card = array.size();
+					if (card > max_array) to_bitmap();
+				}
+			}
+
+			// the bitmap words of this chunk, converting arrays on the fly
+			std::vector<std::uint64_t> words() const {
+				if (is_bitmap()) return bits;
+				std::vector<std::uint64_t> w(nwords, 0);
+				for (auto it=array.begin(); it!=array.end(); it++) w[*it >> 6] |= std::uint64_t(1) << (*it & 63);
+				return w;
+			}
+
+			std::size_t memory_bytes() const {
+				return sizeof(Chunk) + array.capacity()*sizeof(std::uint16_t) + bits.capacity()*sizeof(std::uint64_t);
+			}
+		};
+
+		enum class Op : unsigned int {AND, OR, ANDNOT, XOR};
+
+	public:
+
+		/** @class const_iterator
+		 *  @brief forward iterator over the values in ascending order
+		 *
+		 */
+		class const_iterator{
+		public:
+			typedef const_iterator 						self_type;
+			typedef std::uint32_t 						value_type;
+			typedef std::uint32_t 						reference;
+			typedef const std::uint32_t * 				pointer;
+			typedef std::ptrdiff_t 						difference_type;
+			typedef std::forward_iterator_tag 			iterator_category;
+
+			const_iterator()
+			: mB(nullptr), mC(0), mPos(0) {};
+
+			const_iterator(const RoaringBitmap * b, std::size_t c, std::uint32_t pos)
+			: mB(b), mC(c), mPos(pos) {};
+
+			reference operator*() const {
+				const Chunk & ch = mB->mChunks[mC];
+				std::uint32_t low = ch.is_bitmap() ? mPos : ch.array[mPos];
+				return (std::uint32_t(ch.key) << 16) | low;
+			};
+
+			self_type & operator++(){
+				const Chunk & ch = mB->mChunks[mC];
+				if (ch.is_bitmap()){
+					if (next_bit(ch, mPos+1)) return *this;
+				}
+				else if (++mPos < ch.array.size()) return *this;
+				mC++;
+				mPos = mB->first_position(mC);
+				return *this;
+			};
+
+			self_type operator++(int blah){
+				self_type out(*this);
+				++(*this);
+				return out;
+			};
+
+			bool operator==(const self_type & it) const {return mC == it.mC && mPos == it.mPos;};
+			bool operator!=(const self_type & it) const {return !(*this == it);};
+
+		private:
+			// move to the first set bit at or after "from"
+			bool next_bit(const Chunk & ch, std::uint32_t from){
+				if (from >= 65536) return false;
+				std::size_t w = from >> 6;
+				std::uint64_t word = ch.bits[w] & (~std::uint64_t(0) << (from & 63));
+				while (!word){
+					if (++w == nwords) return false;
+					word = ch.bits[w];
+				}
+				mPos = std::uint32_t(64*w + Detail::ctz64(word));
+				return true;
+			}
+
+			friend class RoaringBitmap;
+
+			const RoaringBitmap * 		mB;
+			std::size_t 				mC;			// chunk
+			std::uint32_t 				mPos;		// array index, or bit for bitmap chunks
+		};
+
+		typedef const_iterator 		iterator;
+
+
+		RoaringBitmap() {};
+
+		// from a sorted or unsorted range of values
+		template <typename IteratorType>
+		RoaringBitmap(IteratorType beg, IteratorType end){
+			for (auto it=beg; it!=end; it++) add(*it);
+		}
+
+		// add a value. Returns true if it was not there yet
+		bool add(std::uint32_t x){
+			std::size_t c = lower_chunk(std::uint16_t(x >> 16));
+			if (c == mChunks.size() || mChunks[c].key != (x >> 16)) mChunks.insert(mChunks.begin()+c, Chunk(std::uint16_t(x >> 16)));
+			return mChunks[c].add(std::uint16_t(x));
+		}
+
+		// remove a value. Returns true if it was there
+		bool remove(std::uint32_t x){
+			std::size_t c = find_chunk(std::uint16_t(x >> 16));
+			if (c == mChunks.size()) return false;
+			bool out = mChunks[c].remove(std::uint16_t(x));
+			if (mChunks[c].card == 0) mChunks.erase(mChunks.begin()+c);
+			return out;
+		}
+
+		bool contains(std::uint32_t x) const {
+			std::size_t c = find_chunk(std::uint16_t(x >> 16));
+			return c != mChunks.size() && mChunks[c].contains(std::uint16_t(x));
+		}
+
+		std::size_t cardinality() const {
+			std::size_t n = 0;
+			for (auto it=mChunks.begin(); it!=mChunks.end(); it++) n += it->card;
+			return n;
+		}
+
+		bool empty() const {return mChunks.empty();};
+
+		void clear() {mChunks.clear();};
+
+		// bytes of heap and object storage in use
+		std::size_t memory_bytes() const {
+			std::size_t n = sizeof(RoaringBitmap);
+			for (auto it=mChunks.begin(); it!=mChunks.end(); it++) n += it->memory_bytes();
+			return n;
+		}
+
+		const_iterator begin() const {return const_iterator(this, 0, first_position(0));};
+		const_iterator end() const {return const_iterator(this, mChunks.size(), 0);};
+
+		// iterator to x, or end() if not present
+		const_iterator find(std::uint32_t x) const {
+			std::size_t c = find_chunk(std::uint16_t(x >> 16));
+			if (c == mChunks.size() || !mChunks[c].contains(std::uint16_t(x))) return end();
+			const Chunk & ch = mChunks[c];
+			if (ch.is_bitmap()) return const_iterator(this, c, x & 0xffff);
+			return const_iterator(this, c, std::lower_bound(ch.array.begin(), ch.array.end(), std::uint16_t(x)) - ch.array.begin());
+		}
+
+		// the values in ascending order
+		template <typename T = std::uint32_t>
+		std::vector<T> to_vector() const {
+			std::vector<T> out(cardinality());
+			copy_to(out.data());
+			return out;
+		}
+
+		// write the values in ascending order to "out", which must hold
+		// cardinality() values, and return their number. Bitmap chunks
+		// are read a word at a time
+		template <typename T>
+		std::size_t copy_to(T * out) const {
+			std::size_t n = 0;
+			for (auto c=mChunks.begin(); c!=mChunks.end(); c++){
+				const std::uint32_t high = std::uint32_t(c->key) << 16;
+				if (c->is_bitmap()){
+					for (std::size_t w=0; w<nwords; w++){
+						for (std::uint64_t word = c->bits[w]; word; word &= word - 1) out[n++] = T(high | std::uint32_t(64*w + Detail::ctz64(word)));
+					}
+				}
+				else{
+					for (auto a=c->array.begin(); a!=c->array.end(); a++) out[n++] = T(high | *a);
+				}
+			}
+			return n;
+		}
+
+		bool operator==(const RoaringBitmap & b) const {
+			if (mChunks.size() != b.mChunks.size()) return false;
+			for (std::size_t c=0; c<mChunks.size(); c++){
+				const Chunk & x = mChunks[c];
+				const Chunk & y = b.mChunks[c];
+				if (x.key != y.key || x.card != y.card || x.array != y.array || x.bits != y.bits) return false;
+			}
+			return true;
+		}
+		bool operator!=(const RoaringBitmap & b) const {return !(*this == b);};
+
+		// set algebra
+		friend RoaringBitmap operator&(const RoaringBitmap & a, const RoaringBitmap & b) {return combine(a, b, Op::AND);};
+		friend RoaringBitmap operator|(const RoaringBitmap & a, const RoaringBitmap & b) {return combine(a, b, Op::OR);};
+		friend RoaringBitmap operator-(const RoaringBitmap & a, const RoaringBitmap & b) {return combine(a, b, Op::ANDNOT);};
+		friend RoaringBitmap operator^(const RoaringBitmap & a, const RoaringBitmap & b) {return combine(a, b, Op::XOR);};
+
+	private:
+		std::size_t lower_chunk(std::uint16_t key) const {
+			std::size_t lo = 0, hi = mChunks.size();
+			while (lo < hi){
+				std::size_t mid = (lo + hi)/2;
+				if (mChunks[mid].key < key) lo = mid+1;
+				else hi = mid;
+			}
+			return lo;
+		}
+
+		std::size_t find_chunk(std::uint16_t key) const {
+			std::size_t c = lower_chunk(key);
+			return (c < mChunks.size() && mChunks[c].key == key) ? c : mChunks.size();
+		}
+
+		// position of the first value of chunk c
+		std::uint32_t first_position(std::size_t c) const {
+			if (c >= mChunks.size() || !mChunks[c].is_bitmap()) return 0;
+			const Chunk & ch = mChunks[c];
+			std::size_t w = 0;
+			while (!ch.bits[w]) w++;
+			return std::uint32_t(64*w + Detail::ctz64(ch.bits[w]));
+		}
+
+		static bool keep_left(Op op) {return op == Op::OR || op == Op::ANDNOT || op == Op::XOR;};
+		static bool keep_right(Op op) {return op == Op::OR || op == Op::XOR;};
+
+		// combine two chunks with the same key
+		static Chunk combine(const Chunk & x, const Chunk & y, Op op){
+			Chunk out(x.key);
+			if (!x.is_bitmap() && !y.is_bitmap()){
+				auto o = std::back_inserter(out.array);
+				switch (op){
+					case Op::AND: 		std::set_intersection(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), o); break;
+					case Op::OR: 		std::set_union(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), o); break;
+					case Op::ANDNOT: 	std::set_difference(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), o); break;
+					case Op::XOR: 		std::set_symmetric_difference(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), o); break;
+				}
+			}
+			else if (op == Op::AND && !x.is_bitmap()){
+				for (auto it=x.array.begin(); it!=x.array.end(); it++) if (y.contains(*it)) out.array.push_back(*it);
+			}
+			else if (op == Op::AND && !y.is_bitmap()){
+				for (auto it=y.array.begin(); it!=y.array.end(); it++) if (x.contains(*it)) out.array.push_back(*it);
+			}
+			else if (op == Op::ANDNOT && !x.is_bitmap()){
+				for (auto it=x.array.begin(); it!=x.array.end(); it++) if (!y.contains(*it)) out.array.push_back(*it);
+			}
+			else{
+				// word by word
+				std::vector<std::uint64_t> a = x.words();
+				std::vector<std::uint64_t> b = y.words();
+				std::uint64_t * pa = a.data();
+				const std::uint64_t * pb = b.data();
+				switch (op){
+					case Op::AND:
+						#pragma omp simd
+						for (std::size_t w=0; w<nwords; w++) pa[w] &= pb[w];
+						break;
+					case Op::OR:
+						#pragma omp simd
+						for (std::size_t w=0; w<nwords; w++) pa[w] |= pb[w];
+						break;
+					case Op::ANDNOT:
+						#pragma omp simd
+						for (std::size_t w=0; w<nwords; w++) pa[w] &= ~pb[w];
+						break;
+					case Op::XOR:
+						#pragma omp simd
+						for (std::size_t w=0; w<nwords; w++) pa[w] ^= pb[w];
+						break;
+				}
+				out.bits.swap(a);
+			}
+			out.normalize();
+			return out;
+		}
+
+		static RoaringBitmap combine(const RoaringBitmap & a, const RoaringBitmap & b, Op op){
+			RoaringBitmap out;
+			std::size_t i = 0, j = 0;
+			while (i < a.mChunks.size() || j < b.mChunks.size()){
+				if (j == b.mChunks.size() || (i < a.mChunks.size() && a.mChunks[i].key < b.mChunks[j].key)){
+					if (keep_left(op)) out.mChunks.push_back(a.mChunks[i]);
+					i++;
+				}
+				else if (i == a.mChunks.size() || b.mChunks[j].key < a.mChunks[i].key){
+					if (keep_right(op)) out.mChunks.push_back(b.mChunks[j]);
+					j++;
+				}
+				else{
+					Chunk c = combine(a.mChunks[i], b.mChunks[j], op);
+					if (c.card > 0) out.mChunks.push_back(std::move(c));
+					i++;
+					j++;
+				}
+			}
+			return out;
+		}
+
+		std::vector<Chunk> 			mChunks;		// sorted by key
+	};
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,152 @@
+/** @file Schedule.hpp
+ *  @brief file with loop schedules for for_each_parallel
+ *
+ *  This contains the Schedule description used by
+ *  for_each_parallel, and the ScheduleTuner which
+ *  picks a schedule by timing the first few calls
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _SCHEDULE_H
+#define _SCHEDULE_H
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+
+#include <omp.h>
+
+namespace simbox{
+
+
+	enum class ScheduleKind : unsigned int {STEAL=0, STATIC, DYNAMIC, GUIDED};
+
+	inline std::string get_string(ScheduleKind k){
+		switch (k){
+			case ScheduleKind::STEAL: return "steal";
+			case ScheduleKind::STATIC: return "static";
+			case ScheduleKind::DYNAMIC: return "dynamic";
+			case ScheduleKind::GUIDED: return "guided";
+		}
+		return "steal";
+	}
+
+
+	/** @class Schedule
+	 *  @brief how for_each_parallel splits a range between threads
+	 *
+	 *  STEAL uses the WorkStealingExecutor with "chunk" as grain size.
+	 *  STATIC, DYNAMIC and GUIDED are the OpenMP schedules of the same
+	 *  name with "chunk" as chunk size. A chunk of 0 means "let the
+	 *  backend choose"
+	 *
+	 */
+	struct Schedule{
+		ScheduleKind 		kind;
+		std::size_t 		chunk;
+
+		Schedule(ScheduleKind k = ScheduleKind::STEAL, std::size_t c = 0)
+		: kind(k), chunk(c) {};
+
+		void print_summary(std::ostream & os = std::cout) const {
+			os << "<Schedule kind=\"" << get_string(kind) << "\" chunk=\"" << chunk << "\"/>" << std::endl;
+		}
+	};
+
+
+	// the schedule used by for_each_parallel when none is given
+	inline Schedule & default_schedule(){
+		static Schedule s;
+		return s;
+	}
+
+	inline void set_default_schedule(Schedule s) {default_schedule() = s;};
+
+
+
+	// tag that asks for_each_parallel to tune the schedule of the
+	// calling kernel automatically (one ScheduleTuner per kernel type)
+	struct AutoTune {};
+	constexpr AutoTune autotune{};
+
+
+
+	/** @class ScheduleTuner
+	 *  @brief settles on a schedule for one call site
+	 *
+	 *  The first few invocations each try a candidate schedule and
+	 *  record the time per element. Once every candidate has been tried
+	 *  "trials" times the fastest is kept for all later invocations.
+	 *
+	 *  Candidates are stored as chunks-per-thread rather than chunk sizes
+	 *  so that the result carries over between calls with different
+	 *  range sizes. A tuner is not synchronized, so it must not be
+	 *  shared by loops launched from different threads
+	 *
+	 */
+	class ScheduleTuner{
+	public:
+		ScheduleTuner(unsigned int trials = 2)
+		: mTrials(trials), mCalls(0), mBest(0) {
+			mCandidates.push_back(Candidate{ScheduleKind::STATIC, 1});
+			mCandidates.push_back(Candidate{ScheduleKind::DYNAMIC, 4});
+			mCandidates.push_back(Candidate{ScheduleKind::DYNAMIC, 16});
+			mCandidates.push_back(Candidate{ScheduleKind::DYNAMIC, 64});
+			mCandidates.push_back(Candidate{ScheduleKind::GUIDED, 16});
+			mCandidates.push_back(Candidate{ScheduleKind::STEAL, 8});
+			mTimes.assign(mCandidates.size(), std::numeric_limits<double>::max());
+		};
+
+		bool tuned() const {return mCalls >= mTrials*mCandidates.size();};
+
+		// the schedule to use for the next call on a range of size n
+		Schedule next(std::size_t n) const {
+			const Candidate & c = mCandidates[tuned() ? mBest : mCalls % mCandidates.size()];
+			return Schedule(c.kind, std::max<std::size_t>(1, n/(c.per_thread*omp_get_max_threads())));
+		}
+
+		// record the run time of the call that used next(n)
+		void record(std::size_t n, double seconds){
+			if (tuned() || n == 0) return;
+			std::size_t i = mCalls % mCandidates.size();
+			mTimes[i] = std::min(mTimes[i], seconds/n);
+			mCalls++;
+			if (tuned()) mBest = std::min_element(mTimes.begin(), mTimes.end()) - mTimes.begin();
+		}
+
+		// start over, e.g. after the thread count changes
+		void reset(){
+			mCalls = 0;
+			mBest = 0;
+			mTimes.assign(mCandidates.size(), std::numeric_limits<double>::max());
+		}
+
+		void print_summary(std::ostream & os = std::cout) const {
+			os << "<ScheduleTuner tuned=\"" << tuned() << "\">" << std::endl;
+			for (std::size_t i=0; i<mCandidates.size(); i++){
+				os << "\t<Candidate kind=\"" << get_string(mCandidates[i].kind) << "\" per_thread=\"" << mCandidates[i].per_thread << "\"";
+				os << " time_per_element=\"" << mTimes[i] << "\"" << (tuned() && i == mBest ? " best=\"1\"" : "") << "/>" << std::endl;
+			}
+			os << "</ScheduleTuner>" << std::endl;
+		}
+
+	private:
+		struct Candidate{
+			ScheduleKind 		kind;
+			std::size_t 		per_thread;
+		};
+
+		unsigned int 				mTrials;
+		std::size_t 				mCalls;
+		std::size_t 				mBest;
+		std::vector<Candidate> 		mCandidates;
+		std::vector<double> 		mTimes;
+	};
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,211 @@
+/** @file SetAlgebra.hpp
+ *  @brief file with parallel operations on sorted key arrays
+ *
+ *  This contains parallel_set_operation, which computes the
+ *  intersection, difference, union or xor of two sorted
+ *  arrays of unique keys with merge-path partitioning, and
+ *  writes the result into a caller-provided buffer
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _SETALGEBRA_H
+#define _SETALGEBRA_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "WorkStealing.hpp"
+
+namespace simbox{
+
+
+	// logical operations between two sets
+	enum class SetOperation : unsigned int {INTERSECTION=0, DIFFERENCE, UNION, XOR};
+
+	// the largest possible result of an operation, which is the
+	// buffer size needed by parallel_set_operation
+	inline std::size_t max_result_size(SetOperation op, std::size_t na, std::size_t nb){
+		switch (op){
+			case SetOperation::INTERSECTION: 	return std::min(na, nb);
+			case SetOperation::DIFFERENCE: 		return na;
+			default: 							return na + nb;
+		}
+	}
+
+
+
+	namespace Detail{
+		// block width of the vectorized merge steps
+		static constexpr std::size_t merge_block = 8;
+
+		// merge path split: the first i elements of a and j elements of b,
+		// i + j = d, that come first when a and b are merged. Equal keys
+		// are kept on the same side of the split
+		template <typename T>
+		std::pair<std::size_t, std::size_t> merge_split(const T * a, std::size_t na, const T * b, std::size_t nb, std::size_t d){
+			std::size_t lo = d > nb ? d - nb : 0;
+			std::size_t hi = std::min(d, na);
+			while (lo < hi){
+				std::size_t mid = (lo + hi)/2;
+				if (!(b[d-mid-1] < a[mid])) lo = mid+1;
+				else hi = mid;
+			}
+			std::size_t i = lo, j = d - lo;
+			if (i > 0 && j < nb && !(a[i-1] < b[j]) && !(b[j] < a[i-1])) j++;
+			return std::make_pair(i, j);
+		}
+
+		// each of the merges below writes to "out" if it is not null, and
+		// returns the number of keys in the result. Blocks of merge_block keys
+		// that lie entirely below the other array are skipped or copied in
+		// one step, and overlapping blocks are intersected all-against-all
+		// in a loop the compiler vectorizes
+
+		template <typename T>
+		std::size_t intersect_range(const T * a, std::size_t na, const T * b, std::size_t nb, T * out){
+			const std::size_t W = merge_block;
+			std::size_t i = 0, j = 0, n = 0;
+			while (i+W <= na && j+W <= nb){
+				if (a[i+W-1] < b[j]) {i += W; continue;}
+				if (b[j+W-1] < a[i]) {j += W; continue;}
+
+				unsigned char hit[W];
+				#pragma omp simd
+				for (std::size_t k=0; k<W; k++){
+					unsigned char h = 0;
+					for (std::size_t l=0; l<W; l++) h |= (a[i+k] == b[j+l]);
+					hit[k] = h;
+				}
+				for (std::size_t k=0; k<W; k++){
+					if (hit[k]){
+						if (out) out[n] = a[i+k];
+						n++;
+					}
+				}
+
+				const T amax = a[i+W-1], bmax = b[j+W-1];
+				if (!(bmax < amax)) i += W;
+				if (!(amax < bmax)) j += W;
+			}
+			while (i < na && j < nb){
+				if (a[i] < b[j]) i++;
+				else if (b[j] < a[i]) j++;
+				else{
+					if (out) out[n] = a[i];
+					n++; i++; j++;
+				}
+			}
+			return n;
+		}
+
+		template <typename T>
+		std::size_t copy_block(const T * src, std::size_t len, T * out){
+			if (out){
+				#pragma omp simd
+				for (std::size_t k=0; k<len; k++) out[k] = src[k];
+			}
+			return len;
+		}
+
+		// union, difference and xor differ only in which unmatched keys are
+		// kept and whether matched keys are kept
+		template <typename T>
+		std::size_t merge_range(const T * a, std::size_t na, const T * b, std::size_t nb, T * out,
+								bool keep_a, bool keep_b, bool keep_both){
+			const std::size_t W = merge_block;
+			std::size_t i = 0, j = 0, n = 0;
+			while (i < na && j < nb){
+				if (i+W <= na && a[i+W-1] < b[j]){
+					if (keep_a) n += copy_block(a+i, W, out ? out+n : nullptr);
+					i += W;
+				}
+				else if (j+W <= nb && b[j+W-1] < a[i]){
+					if (keep_b) n += copy_block(b+j, W, out ? out+n : nullptr);
+					j += W;
+				}
+				else if (a[i] < b[j]){
+					if (keep_a) {if (out) out[n] = a[i]; n++;}
+					i++;
+				}
+				else if (b[j] < a[i]){
+					if (keep_b) {if (out) out[n] = b[j]; n++;}
+					j++;
+				}
+				else{
+					if (keep_both) {if (out) out[n] = a[i]; n++;}
+					i++; j++;
+				}
+			}
+			if (keep_a) n += copy_block(a+i, na-i, out ? out+n : nullptr);
+			if (keep_b) n += copy_block(b+j, nb-j, out ? out+n : nullptr);
+			return n;
+		}
+
+		template <typename T>
+		std::size_t set_operation_range(SetOperation op, const T * a, std::size_t na, const T * b, std::size_t nb, T * out){
+			switch (op){
+				case SetOperation::INTERSECTION: 	return intersect_range(a, na, b, nb, out);
+				case SetOperation::DIFFERENCE: 		return merge_range(a, na, b, nb, out, true, false, false);
+				case SetOperation::UNION: 			return merge_range(a, na, b, nb, out, true, true, true);
+				case SetOperation::XOR: 			return merge_range(a, na, b, nb, out, true, true, false);
+			}
+			return 0;
+		}
+	} // end namespace Detail
+
+
+
+	// compute "op" of the sorted arrays of unique keys a[0, na) and b[0, nb)
+	// into out, which must hold max_result_size(op, na, nb) keys. Returns
+	// the number of keys written, which come out sorted.
+	//
+	// The merged sequence is cut into one piece per thread along the merge
+	// path, so every thread gets the same share of a and b combined no
+	// matter how the keys interleave. Each thread counts its piece, and then
+	// writes it at its offset. Inputs smaller than "grain" run serially
+	//
+	// e.g.:	std::vector<unsigned int> out(max_result_size(SetOperation::UNION, a.size(), b.size()));
+	// 			out.resize(parallel_set_operation(SetOperation::UNION, a.data(), a.size(), b.data(), b.size(), out.data()));
+	template <typename T>
+	std::size_t parallel_set_operation(SetOperation op, const T * a, std::size_t na, const T * b, std::size_t nb, T * out,
+									   std::size_t grain = std::size_t(1) << 16){
+		OmpTeam team;
+		const int nthreads = team.num_threads();
+		const std::size_t total = na + nb;
+		if (nthreads == 1 || total < grain) return Detail::set_operation_range(op, a, na, b, nb, out);
+
+		std::vector<std::size_t> ia(nthreads+1), jb(nthreads+1), offset(nthreads+1, 0);
+		for (int t=0; t<nthreads; t++){
+			auto s = Detail::merge_split(a, na, b, nb, total*t/nthreads);
+			ia[t] = s.first;
+			jb[t] = s.second;
+		}
+		ia[nthreads] = na;
+		jb[nthreads] = nb;
+
+		// count each piece, then write each piece at its offset
+		team.run([&](int tid){
+			offset[tid+1] = Detail::set_operation_range(op, a+ia[tid], ia[tid+1]-ia[tid], b+jb[tid], jb[tid+1]-jb[tid], (T *)nullptr);
+		});
+		for (int t=0; t<nthreads; t++) offset[t+1] += offset[t];
+		team.run([&](int tid){
+			Detail::set_operation_range(op, a+ia[tid], ia[tid+1]-ia[tid], b+jb[tid], jb[tid+1]-jb[tid], out+offset[tid]);
+		});
+		return offset[nthreads];
+	}
+
+	// the same, into a vector that is resized to the result. Reusing the
+	// same vector between calls avoids allocation once it is large enough
+	template <typename T>
+	std::size_t parallel_set_operation(SetOperation op, const std::vector<T> & a, const std::vector<T> & b, std::vector<T> & out){
+		out.resize(max_result_size(op, a.size(), b.size()));
+		out.resize(parallel_set_operation(op, a.data(), a.size(), b.data(), b.size(), out.data()));
+		return out.size();
+	}
+
+
+} // end namespace simbox
+#endif
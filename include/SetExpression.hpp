@@ -0,0 +1,362 @@
+/** @file SetExpression.hpp
+ *  @brief file with lazy expressions of sets of sorted keys
+ *
+ *  This contains set expression templates, which combine sets
+ *  of sorted keys with |, &, - and ^ without computing anything.
+ *  An expression is evaluated in a single fused merge of all of
+ *  its sets, or iterated lazily key by key, so that no
+ *  intermediate result is stored
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _SETEXPRESSION_H
+#define _SETEXPRESSION_H
+
+#include <vector>
+#include <iterator>
+#include <type_traits>
+
+#include "SetAlgebra.hpp"
+#include "RoaringBitmap.hpp"
+
+namespace simbox{
+
+
+	namespace Detail{
+		// the operations, as types. keep() tells if a key is in the result
+		// given whether it is in each side, and needs_left/needs_right tell
+		// if the result ends once that side is exhausted
+		struct set_intersection_tag{
+			static constexpr SetOperation op = SetOperation::INTERSECTION;
+			static constexpr bool needs_left = true, needs_right = true;
+			static bool keep(bool l, bool r) {return l && r;};
+		};
+
+		struct set_difference_tag{
+			static constexpr SetOperation op = SetOperation::DIFFERENCE;
+			static constexpr bool needs_left = true, needs_right = false;
+			static bool keep(bool l, bool r) {return l && !r;};
+		};
+
+		struct set_union_tag{
+			static constexpr SetOperation op = SetOperation::UNION;
+			static constexpr bool needs_left = false, needs_right = false;
+			static bool keep(bool l, bool r) {return l || r;};
+		};
+
+		struct set_xor_tag{
+			static constexpr SetOperation op = SetOperation::XOR;
+			static constexpr bool needs_left = false, needs_right = false;
+			static bool keep(bool l, bool r) {return l != r;};
+		};
+
+		// an operation between two bitmaps, chunk by chunk
+		inline RoaringBitmap bitmap_set_operation(SetOperation op, const RoaringBitmap & a, const RoaringBitmap & b){
+			switch (op){
+				case SetOperation::INTERSECTION: 	return a & b;
+				case SetOperation::DIFFERENCE: 		return a - b;
+				case SetOperation::UNION: 			return a | b;
+				case SetOperation::XOR: 			return a ^ b;
+			}
+			return RoaringBitmap();
+		}
+	} // end namespace Detail
+
+
+
+	// common base of every expression, for is_set_expression
+	struct SetExpressionBase {};
+
+	/** @class SetExpression
+	 *  @brief base class of every set expression
+	 *
+	 *  Every expression has a cursor, which walks the keys of
+	 *  the result in ascending order with valid(), key() and next().
+	 *  The base provides iteration and evaluation in terms of it.
+	 *  The sets in an expression must not change while it is used
+	 *
+	 */
+	template <typename Derived, typename KeyT>
+	class SetExpression : public SetExpressionBase{
+	public:
+		typedef KeyT 			key_type;
+
+		const Derived & derived() const {return *static_cast<const Derived *>(this);};
+
+		/** @class iterator
+		 *  @brief forward iterator over the keys of the result
+		 */
+		class iterator{
+		public:
+			typedef typename Derived::cursor 			cursor;
+			typedef KeyT 								value_type;
+			typedef const value_type & 					reference;
+			typedef const value_type * 					pointer;
+			typedef std::ptrdiff_t 						difference_type;
+			typedef std::forward_iterator_tag 			iterator_category;
+
+			iterator() : mEnd(true) {};
+			explicit iterator(const cursor & c) : mCursor(c), mEnd(!c.valid()) {};
+
+			reference operator*() const {return mCursor.key();};
+			pointer operator->() const {return &mCursor.key();};
+
+			iterator & operator++(){
+				mCursor.next();
+				mEnd = !mCursor.valid();
+				return *this;
+			}
+
+			iterator operator++(int){
+				iterator out(*this);
+				++(*this);
+				return out;
+			}
+
+			bool operator==(const iterator & other) const {
+				if (mEnd || other.mEnd) return mEnd == other.mEnd;
+				return mCursor.key() == other.mCursor.key();
+			}
+			bool operator!=(const iterator & other) const {return !(*this == other);};
+
+		private:
+			cursor 		mCursor;
+			bool 		mEnd;
+		};
+
+		iterator begin() const {return iterator(derived().make_cursor());};
+		iterator end() const {return iterator();};
+
+		// evaluate into "out", which is resized to the result. Every set is
+		// read once, in a single merge over all of them
+		std::size_t evaluate(std::vector<KeyT> & out) const {
+			out.clear();
+			out.reserve(derived().max_size());
+			for (auto c = derived().make_cursor(); c.valid(); c.next()) out.push_back(c.key());
+			return out.size();
+		}
+
+		std::vector<KeyT> to_vector() const {
+			std::vector<KeyT> out;
+			evaluate(out);
+			return out;
+		}
+
+		// the number of keys in the result
+		std::size_t size() const {
+			std::size_t n = 0;
+			for (auto c = derived().make_cursor(); c.valid(); c.next()) n++;
+			return n;
+		}
+	};
+
+
+
+	/** @class SetTerminal
+	 *  @brief a set in an expression, as a sorted array of unique keys
+	 *
+	 */
+	template <typename KeyT>
+	class SetTerminal : public SetExpression<SetTerminal<KeyT>, KeyT>{
+	public:
+		class cursor{
+		public:
+			cursor() : mPos(nullptr), mEnd(nullptr) {};
+			cursor(const KeyT * beg, const KeyT * end) : mPos(beg), mEnd(end) {};
+
+			bool valid() const {return mPos != mEnd;};
+			const KeyT & key() const {return *mPos;};
+			void next() {mPos++;};
+
+		private:
+			const KeyT * 	mPos;
+			const KeyT * 	mEnd;
+		};
+
+		explicit SetTerminal(const std::vector<KeyT> & keys)
+		: mKeys(&keys) {};
+
+		cursor make_cursor() const {return cursor(mKeys->data(), mKeys->data() + mKeys->size());};
+		std::size_t max_size() const {return mKeys->size();};
+		const std::vector<KeyT> & keys() const {return *mKeys;};
+
+	private:
+		const std::vector<KeyT> * 		mKeys;
+	};
+
+
+
+	/** @class BitmapSetTerminal
+	 *  @brief a set in an expression, as a RoaringBitmap of its keys
+	 *
+	 */
+	template <typename KeyT>
+	class BitmapSetTerminal : public SetExpression<BitmapSetTerminal<KeyT>, KeyT>{
+	public:
+		class cursor{
+		public:
+			cursor() : mKey() {};
+			cursor(RoaringBitmap::const_iterator beg, RoaringBitmap::const_iterator end)
+			: mIt(beg), mEnd(end), mKey() {if (valid()) mKey = KeyT(*mIt);};
+
+			bool valid() const {return mIt != mEnd;};
+			const KeyT & key() const {return mKey;};
+
+			void next(){
+				++mIt;
+				if (valid()) mKey = KeyT(*mIt);
+			}
+
+		private:
+			RoaringBitmap::const_iterator 	mIt;
+			RoaringBitmap::const_iterator 	mEnd;
+			KeyT 							mKey;
+		};
+
+		explicit BitmapSetTerminal(const RoaringBitmap & bits)
+		: mBits(&bits) {};
+
+		cursor make_cursor() const {return cursor(mBits->begin(), mBits->end());};
+		std::size_t max_size() const {return mBits->cardinality();};
+		const RoaringBitmap & bitmap() const {return *mBits;};
+
+	private:
+		const RoaringBitmap * 			mBits;
+	};
+
+
+
+	/** @class SetBinaryExpression
+	 *  @brief an operation between two set expressions
+	 *
+	 *  The cursor merges the cursors of both sides, and stops on
+	 *  the keys the operation keeps
+	 *
+	 */
+	template <typename OpTag, typename Left, typename Right>
+	class SetBinaryExpression : public SetExpression<SetBinaryExpression<OpTag, Left, Right>, typename Left::key_type>{
+	public:
+		typedef typename Left::key_type 		key_type;
+		static_assert(std::is_same<key_type, typename Right::key_type>::value, "Sets in an expression must have the same key type!");
+
+		class cursor{
+		public:
+			cursor() : mValid(false) {};
+			cursor(const typename Left::cursor & l, const typename Right::cursor & r)
+			: mLeft(l), mRight(r), mInLeft(false), mInRight(false) {settle();};
+
+			bool valid() const {return mValid;};
+			const key_type & key() const {return mKey;};
+
+			void next(){
+				if (mInLeft) mLeft.next();
+				if (mInRight) mRight.next();
+				settle();
+			}
+
+		private:
+			typename Left::cursor 		mLeft;
+			typename Right::cursor 		mRight;
+			key_type 					mKey;
+			bool 						mInLeft, mInRight, mValid;
+
+			// move both sides to the next key that is in the result
+			void settle(){
+				while (true){
+					const bool l = mLeft.valid(), r = mRight.valid();
+					if ((!l && !r) || (!l && OpTag::needs_left) || (!r && OpTag::needs_right)){
+						mValid = false;
+						return;
+					}
+					if (l && r){
+						mInLeft = !(mRight.key() < mLeft.key());
+						mInRight = !(mLeft.key() < mRight.key());
+						mKey = mInLeft ? mLeft.key() : mRight.key();
+					}
+					else{
+						mInLeft = l;
+						mInRight = r;
+						mKey = l ? mLeft.key() : mRight.key();
+					}
+					if (OpTag::keep(mInLeft, mInRight)){
+						mValid = true;
+						return;
+					}
+					if (mInLeft) mLeft.next();
+					if (mInRight) mRight.next();
+				}
+			}
+		};
+
+		SetBinaryExpression(const Left & l, const Right & r)
+		: mLeft(l), mRight(r) {};
+
+		cursor make_cursor() const {return cursor(mLeft.make_cursor(), mRight.make_cursor());};
+		std::size_t max_size() const {return max_result_size(OpTag::op, mLeft.max_size(), mRight.max_size());};
+
+		const Left & left() const {return mLeft;};
+		const Right & right() const {return mRight;};
+
+	private:
+		Left 		mLeft;
+		Right 		mRight;
+	};
+
+
+
+	// an operation between two sets only (no nested expression) runs the
+	// parallel merge of SetAlgebra.hpp instead
+	template <typename OpTag, typename KeyT>
+	std::size_t evaluate(const SetBinaryExpression<OpTag, SetTerminal<KeyT>, SetTerminal<KeyT>> & e, std::vector<KeyT> & out){
+		return parallel_set_operation(OpTag::op, e.left().keys(), e.right().keys(), out);
+	}
+
+	// and one between two bitmaps combines them chunk by chunk
+	template <typename OpTag, typename KeyT>
+	std::size_t evaluate(const SetBinaryExpression<OpTag, BitmapSetTerminal<KeyT>, BitmapSetTerminal<KeyT>> & e, std::vector<KeyT> & out){
+		RoaringBitmap r = Detail::bitmap_set_operation(OpTag::op, e.left().bitmap(), e.right().bitmap());
+		out.resize(r.cardinality());
+		return r.copy_to(out.data());
+	}
+
+	template <typename Derived, typename KeyT>
+	std::size_t evaluate(const SetExpression<Derived, KeyT> & e, std::vector<KeyT> & out){
+		return e.evaluate(out);
+	}
+
+
+
+	template <typename T>
+	struct is_set_expression : public std::is_base_of<SetExpressionBase, T> {};
+
+	// the operators only apply to set expressions
+	//
+	// e.g.:	auto q = (m.query("inlet") | m.query("wall")) - m.query("corner");
+	// 			for (auto k : q) ...						// lazily
+	// 			std::vector<unsigned int> keys;
+	// 			evaluate(q, keys);							// in one pass
+	template <typename L, typename R>
+	typename std::enable_if<is_set_expression<L>::value && is_set_expression<R>::value,
+							SetBinaryExpression<Detail::set_union_tag, L, R>>::type
+	operator|(const L & l, const R & r) {return SetBinaryExpression<Detail::set_union_tag, L, R>(l, r);};
+
+	template <typename L, typename R>
+	typename std::enable_if<is_set_expression<L>::value && is_set_expression<R>::value,
+							SetBinaryExpression<Detail::set_intersection_tag, L, R>>::type
+	operator&(const L & l, const R & r) {return SetBinaryExpression<Detail::set_intersection_tag, L, R>(l, r);};
+
+	template <typename L, typename R>
+	typename std::enable_if<is_set_expression<L>::value && is_set_expression<R>::value,
+							SetBinaryExpression<Detail::set_difference_tag, L, R>>::type
+	operator-(const L & l, const R & r) {return SetBinaryExpression<Detail::set_difference_tag, L, R>(l, r);};
+
+	template <typename L, typename R>
+	typename std::enable_if<is_set_expression<L>::value && is_set_expression<R>::value,
+							SetBinaryExpression<Detail::set_xor_tag, L, R>>::type
+	operator^(const L & l, const R & r) {return SetBinaryExpression<Detail::set_xor_tag, L, R>(l, r);};
+
+
+} // end namespace simbox
+#endif
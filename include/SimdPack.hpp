@@ -0,0 +1,223 @@
+/** @file SimdPack.hpp
+ *  @brief file with the SimdPack class
+ *
+ *  This contains a small portable fixed-width SIMD
+ *  wrapper, and for_each_simd, which calls a functor
+ *  on packs of a contiguous container with a scalar
+ *  remainder loop
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _SIMDPACK_H
+#define _SIMDPACK_H
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "WorkStealing.hpp"
+
+namespace simbox{
+
+
+	/** @class SimdPack
+	 *  @brief W values of type T that are operated on together
+	 *
+	 *  Every operation is a fixed-length loop marked "omp simd", which
+	 *  compilers turn into single vector instructions for the usual
+	 *  widths (4 or 8 doubles, 8 or 16 floats). Arithmetic works between
+	 *  packs and between a pack and a scalar, so the same generic functor
+	 *  body can be used for packs and for the scalar remainder
+	 *
+	 */
+	template <typename T, std::size_t W>
+	struct alignas(sizeof(T)*W) SimdPack{
+		static_assert(W > 0 && (W & (W-1)) == 0, "SimdPack width must be a power of two!");
+		static_assert(!std::is_const<T>::value, "SimdPack must hold mutable values!");
+
+		T 		v[W];
+
+		static constexpr std::size_t width = W;
+
+		SimdPack() {};
+
+		// broadcast
+		SimdPack(T s){
+			#pragma omp simd
+			for (std::size_t i=0; i<W; i++) v[i] = s;
+		};
+
+		static SimdPack load(const T * p){
+			SimdPack r;
+			#pragma omp simd
+			for (std::size_t i=0; i<W; i++) r.v[i] = p[i];
+			return r;
+		}
+
+		void store(T * p) const {
+			#pragma omp simd
+			for (std::size_t i=0; i<W; i++) p[i] = v[i];
+		}
+
+		T & operator[](std::size_t i) {return v[i];};
+		const T & operator[](std::size_t i) const {return v[i];};
+
+		#define SIMBOX_SIMDPACK_COMPOUND(op) \
+		SimdPack & operator op##=(const SimdPack & b){ \
+			_Pragma("omp simd") \
+			for (std::size_t i=0; i<W; i++) v[i] op##= b.v[i]; \
+			return *this; \
+		} \
+		SimdPack & operator op##=(T s){ \
+			_Pragma("omp simd") \
+			for (std::size_t i=0; i<W; i++) v[i] op##= s; \
+			return *this; \
+		}
+
+		SIMBOX_SIMDPACK_COMPOUND(+)
+		SIMBOX_SIMDPACK_COMPOUND(-)
+		SIMBOX_SIMDPACK_COMPOUND(*)
+		SIMBOX_SIMDPACK_COMPOUND(/)
+		#undef SIMBOX_SIMDPACK_COMPOUND
+
+		SimdPack operator-() const {
+			SimdPack r;
+			#pragma omp simd
+			for (std::size_t i=0; i<W; i++) r.v[i] = -v[i];
+			return r;
+		}
+	};
+
+
+	#define SIMBOX_SIMDPACK_BINARY(op) \
+	template <typename T, std::size_t W> \
+	SimdPack<T, W> operator op(SimdPack<T, W> a, const SimdPack<T, W> & b) {return a op##= b;}; \
+	template <typename T, std::size_t W> \
+	SimdPack<T, W> operator op(SimdPack<T, W> a, T s) {return a op##= s;}; \
+	template <typename T, std::size_t W> \
+	SimdPack<T, W> operator op(T s, const SimdPack<T, W> & b) {return SimdPack<T, W>(s) op##= b;};
+
+	SIMBOX_SIMDPACK_BINARY(+)
+	SIMBOX_SIMDPACK_BINARY(-)
+	SIMBOX_SIMDPACK_BINARY(*)
+	SIMBOX_SIMDPACK_BINARY(/)
+	#undef SIMBOX_SIMDPACK_BINARY
+
+
+	// elementwise functions. These are found by argument-dependent lookup,
+	// so an unqualified sqrt(x) in a functor works for packs and scalars alike
+	template <typename T, std::size_t W>
+	SimdPack<T, W> sqrt(const SimdPack<T, W> & a){
+		SimdPack<T, W> r;
+		#pragma omp simd
+		for (std::size_t i=0; i<W; i++) r.v[i] = std::sqrt(a.v[i]);
+		return r;
+	}
+
+	template <typename T, std::size_t W>
+	SimdPack<T, W> abs(const SimdPack<T, W> & a){
+		SimdPack<T, W> r;
+		#pragma omp simd
+		for (std::size_t i=0; i<W; i++) r.v[i] = std::abs(a.v[i]);
+		return r;
+	}
+
+	template <typename T, std::size_t W>
+	SimdPack<T, W> min(const SimdPack<T, W> & a, const SimdPack<T, W> & b){
+		SimdPack<T, W> r;
+		#pragma omp simd
+		for (std::size_t i=0; i<W; i++) r.v[i] = (b.v[i] < a.v[i] ? b.v[i] : a.v[i]);
+		return r;
+	}
+
+	template <typename T, std::size_t W>
+	SimdPack<T, W> max(const SimdPack<T, W> & a, const SimdPack<T, W> & b){
+		SimdPack<T, W> r;
+		#pragma omp simd
+		for (std::size_t i=0; i<W; i++) r.v[i] = (a.v[i] < b.v[i] ? b.v[i] : a.v[i]);
+		return r;
+	}
+
+
+
+	// mutable iterators whose elements are contiguous in memory (packs
+	// are stored back through them). vector<bool> packs its bits, so
+	// bool never qualifies. Specialize this for other containers that
+	// store their elements contiguously
+	template <typename IteratorType>
+	struct is_contiguous_iterator{
+	private:
+		typedef typename std::iterator_traits<IteratorType>::value_type 	value_type;
+		typedef typename std::remove_pointer<IteratorType>::type 			pointee;
+	public:
+		static constexpr bool value = !std::is_same<value_type, bool>::value
+								   && ((std::is_pointer<IteratorType>::value && !std::is_const<pointee>::value)
+									   || std::is_same<IteratorType, typename std::vector<value_type>::iterator>::value);
+	};
+
+
+
+	namespace Detail{
+		template <std::size_t W, class T, class Functor, typename... Args>
+		void for_each_pack_range(T * p, std::size_t n, Functor & u, Args & ... a){
+			std::size_t npack = n/W*W;
+			for (std::size_t i=0; i<npack; i+=W){
+				SimdPack<T, W> pk = SimdPack<T, W>::load(p+i);
+				u.operator()(pk, a...);
+				pk.store(p+i);
+			}
+			// scalar remainder
+			for (std::size_t i=npack; i<n; i++) u.operator()(p[i], a...);
+		}
+	} // end namespace Detail
+
+
+	// for_each over a contiguous container, calling the functor on SimdPacks
+	// of W elements, followed by a scalar remainder loop. The first argument
+	// to the functor must accept both SimdPack<T, W> & and T &, so it is
+	// usually a template (or generic lambda). Following arguments are passed
+	// successively to the functor.
+	//
+	// e.g.:	struct Update{
+	// 				template <typename V> void operator()(V & u, double dt) const {u += dt*(1.0 - u);};
+	// 			};
+	// 			for_each_simd<4>(a.begin(), a.end(), Update(), dt);
+	template <std::size_t W,
+			  class IteratorType,
+			  class Functor,
+			  typename... Args>
+	void for_each_simd(IteratorType beg, IteratorType end, Functor u, Args && ... a){
+		static_assert(is_contiguous_iterator<IteratorType>::value, "Must be a contiguous iterator to use SIMD packs!");
+		if (beg == end) return;
+		Detail::for_each_pack_range<W>(&(*beg), end - beg, u, a...);
+	}
+
+	// parallelized version of for_each_simd. Pieces are work-stolen between
+	// threads and always start at a multiple of W from beg
+	template <std::size_t W,
+			  class IteratorType,
+			  class Functor,
+			  typename... Args>
+	void for_each_simd_parallel(IteratorType beg, IteratorType end, Functor u, Args... a){
+		static_assert(is_contiguous_iterator<IteratorType>::value, "Must be a contiguous iterator to use SIMD packs!");
+		if (beg == end) return;
+
+		auto p = &(*beg);
+		std::size_t n = end - beg;
+		std::size_t npacks = (n + W - 1)/W;
+		WorkStealingExecutor ex;
+		ex.run(npacks, [&](std::size_t first, std::size_t last){
+			std::size_t lo = first*W;
+			std::size_t hi = std::min(n, last*W);
+			Detail::for_each_pack_range<W>(p+lo, hi-lo, u, a...);
+		});
+	}
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,419 @@
+/** @file SoANodeContainer.hpp
+ *  @brief file with a structure-of-arrays node container
+ *
+ *  This contains soa_node_container, a node container policy
+ *  for GenericMesh that stores each coordinate and each field
+ *  of the nodes in a separate aligned array. Iterators yield
+ *  proxy references, so nodes are still used as it->x(), while
+ *  kernels over one component stream through one array
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _SOANODECONTAINER_H
+#define _SOANODECONTAINER_H
+
+#include <array>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Numa.hpp"
+
+namespace simbox{
+
+
+	// allocator of memory aligned to Align bytes (a cache line by default),
+	// so that arrays start on a vector register boundary. As with
+	// default_init_allocator (Numa.hpp), new elements are default-initialized,
+	// so resize() leaves the pages of trivial types untouched
+	template <typename T, std::size_t Align = 64>
+	struct aligned_allocator{
+		static_assert((Align & (Align-1)) == 0 && Align >= alignof(void *), "Alignment must be a power of two!");
+		typedef T 		value_type;
+
+		template <typename U>
+		struct rebind{
+			typedef aligned_allocator<U, Align> other;
+		};
+
+		aligned_allocator() {};
+
+		template <typename U>
+		aligned_allocator(const aligned_allocator<U, Align> &) {};
+
+		// the pointer returned by operator new is kept just before
+		// the aligned block
+		T * allocate(std::size_t n){
+			void * raw = ::operator new(n*sizeof(T) + Align + sizeof(void *));
+			std::uintptr_t a = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void *) + Align - 1) & ~std::uintptr_t(Align - 1);
+			reinterpret_cast<void **>(a)[-1] = raw;
+			return reinterpret_cast<T *>(a);
+		}
+
+		void deallocate(T * p, std::size_t) {::operator delete(reinterpret_cast<void **>(p)[-1]);};
+
+		template <typename U>
+		void construct(U * p) {::new(static_cast<void *>(p)) U;};
+
+		template <typename U, typename... Args>
+		void construct(U * p, Args && ... a) {::new(static_cast<void *>(p)) U(std::forward<Args>(a)...);};
+
+		template <typename U>
+		bool operator==(const aligned_allocator<U, Align> &) const {return true;};
+		template <typename U>
+		bool operator!=(const aligned_allocator<U, Align> &) const {return false;};
+	};
+
+	template <typename T>
+	using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+
+
+	/** @class soa_node_container
+	 *  @brief nodes stored as one array per component
+	 *
+	 *  Each node has Dim coordinates of type T and one value of
+	 *  each of the Fields. Coordinate d of every node is in
+	 *  coordinate(d), and field I of every node is in field<I>(),
+	 *  each an aligned_vector. Iteration yields a proxy
+	 *  reference with x(), y(), z(), coord(d) and get<I>(), which
+	 *  refer into the arrays, and node_value is the matching
+	 *  standalone node
+	 *
+	 *  e.g.:	simbox::GenericMesh<soa_node_container<2, double, float>, void, cell_cont> mesh;
+	 *  		mesh.nodes().emplace_back({0.5, 1.0}, 0.0f);
+	 *  		for (auto it=mesh.nodes().begin(); it!=mesh.nodes().end(); it++) it->get<0>() = it->x();
+	 *
+	 *  		// or component-wise, over one array
+	 *  		double * x = mesh.nodes().coordinate(0).data();
+	 *  		#pragma omp simd
+	 *  		for (std::size_t i=0; i<mesh.nodes().size(); i++) x[i] += dx;
+	 *
+	 *  		// or placed for the threads that will work on it
+	 *  		mesh.nodes().first_touch_resize(n);
+	 */
+	template <std::size_t Dim, typename T = double, typename... Fields>
+	class soa_node_container{
+		// true if T or any field is bool
+		static constexpr bool has_bool(){
+			const bool b[] = {std::is_same<T, bool>::value, std::is_same<Fields, bool>::value...};
+			for (std::size_t i=0; i<sizeof(b)/sizeof(b[0]); i++) if (b[i]) return true;
+			return false;
+		}
+
+		static_assert(Dim >= 1, "Nodes must have at least one coordinate!");
+		static_assert(!has_bool(), "Use char instead of bool, which std::vector packs into bits!");
+
+		typedef std::tuple<Fields...> 							field_tuple;
+		typedef std::tuple<aligned_vector<Fields>...> 			field_arrays;
+		typedef std::make_index_sequence<sizeof...(Fields)> 	field_indices;
+
+		template <std::size_t I>
+		using field_type = typename std::tuple_element<I, field_tuple>::type;
+
+	public:
+		typedef std::size_t 				size_type;
+		typedef std::ptrdiff_t 				difference_type;
+		typedef T 							coordinate_type;
+
+		/** @class node_value
+		 *  @brief a standalone node, with the same accessors as a reference
+		 */
+		class node_value{
+		public:
+			node_value()
+			: mCoords(), mFields() {};
+
+			node_value(const std::array<T, Dim> & c, const Fields & ... f)
+			: mCoords(c), mFields(f...) {};
+
+			T & x() {return mCoords[0];};
+			const T & x() const {return mCoords[0];};
+
+			template <std::size_t D = Dim>
+			typename std::enable_if<(D > 1), T &>::type y() {return mCoords[1];};
+			template <std::size_t D = Dim>
+			typename std::enable_if<(D > 1), const T &>::type y() const {return mCoords[1];};
+
+			template <std::size_t D = Dim>
+			typename std::enable_if<(D > 2), T &>::type z() {return mCoords[2];};
+			template <std::size_t D = Dim>
+			typename std::enable_if<(D > 2), const T &>::type z() const {return mCoords[2];};
+
+			T & coord(std::size_t d) {return mCoords[d];};
+			const T & coord(std::size_t d) const {return mCoords[d];};
+
+			template <std::size_t I>
+			field_type<I> & get() {return std::get<I>(mFields);};
+			template <std::size_t I>
+			const field_type<I> & get() const {return std::get<I>(mFields);};
+
+		private:
+			friend class soa_node_container;
+
+			std::array<T, Dim> 		mCoords;
+			field_tuple 			mFields;
+		};
+
+
+
+		/** @class node_reference
+		 *  @brief proxy for the node at one index of the container
+		 *
+		 *  Copies refer to the same node, and assignment writes the
+		 *  values of the other node through to the arrays
+		 */
+		template <bool IsConst>
+		class node_reference{
+		public:
+			typedef typename std::conditional<IsConst, const soa_node_container, soa_node_container>::type 	container_type;
+			typedef typename std::conditional<IsConst, const T, T>::type 								value_type;
+
+			node_reference(container_type * c, size_type i)
+			: mC(c), mI(i) {};
+
+			node_reference(const node_reference & r)
+			: mC(r.mC), mI(r.mI) {};
+
+			// a const reference from a mutable one
+			template <bool C, typename = typename std::enable_if<IsConst && !C>::type>
+			node_reference(const node_reference<C> & r)
+			: mC(r.container()), mI(r.index()) {};
+
+			value_type & x() const {return mC->mCoords[0][mI];};
+
+			template <std::size_t D = Dim>
+			typename std::enable_if<(D > 1), value_type &>::type y() const {return mC->mCoords[1][mI];};
+
+			template <std::size_t D = Dim>
+			typename std::enable_if<(D > 2), value_type &>::type z() const {return mC->mCoords[2][mI];};
+
+			value_type & coord(std::size_t d) const {return mC->mCoords[d][mI];};
+
+			template <std::size_t I>
+			typename std::conditional<IsConst, const field_type<I>, field_type<I>>::type & get() const {return std::get<I>(mC->mFields)[mI];};
+
+			size_type index() const {return mI;};
+			container_type * container() const {return mC;};
+
+			// a copy of the node
+			operator node_value() const {
+				node_value v;
+				for (std::size_t d=0; d<Dim; d++) v.mCoords[d] = mC->mCoords[d][mI];
+				mC->gather(mI, v.mFields, field_indices());
+				return v;
+			}
+
+			const node_reference & operator=(const node_value & v) const {
+				for (std::size_t d=0; d<Dim; d++) mC->mCoords[d][mI] = v.mCoords[d];
+				mC->scatter(mI, v.mFields, field_indices());
+				return *this;
+			}
+
+			const node_reference & operator=(const node_reference & r) const {return *this = node_value(r);};
+
+			friend void swap(node_reference a, node_reference b){
+				node_value t = a;
+				a = b;
+				b = t;
+			}
+
+		private:
+			container_type * 	mC;
+			size_type 			mI;
+		};
+
+
+
+		// what iterator::operator-> returns, so that it->x() works on a proxy
+		template <typename Reference>
+		struct arrow_proxy{
+			Reference r;
+			Reference * operator->() {return &r;};
+		};
+
+		/** @class node_iterator
+		 *  @brief random access iterator over the nodes, by index
+		 */
+		template <bool IsConst>
+		class node_iterator{
+		public:
+			typedef node_value 										value_type;
+			typedef node_reference<IsConst> 						reference;
+			typedef arrow_proxy<reference> 							pointer;
+			typedef std::ptrdiff_t 									difference_type;
+			typedef std::random_access_iterator_tag 				iterator_category;
+			typedef typename reference::container_type 				container_type;
+
+			node_iterator()
+			: mC(nullptr), mI(0) {};
+
+			node_iterator(container_type * c, size_type i)
+			: mC(c), mI(i) {};
+
+			// a const iterator from a mutable one
+			template <bool C, typename = typename std::enable_if<IsConst && !C>::type>
+			node_iterator(const node_iterator<C> & it)
+			: mC(it.container()), mI(it.index()) {};
+
+			reference operator*() const {return reference(mC, mI);};
+			pointer operator->() const {return pointer{reference(mC, mI)};};
+			reference operator[](difference_type n) const {return reference(mC, mI+n);};
+
+			node_iterator & operator++() {mI++; return *this;};
+			node_iterator operator++(int) {node_iterator out(*this); mI++; return out;};
+			node_iterator & operator--() {mI--; return *this;};
+			node_iterator operator--(int) {node_iterator out(*this); mI--; return out;};
+			node_iterator & operator+=(difference_type n) {mI += n; return *this;};
+			node_iterator & operator-=(difference_type n) {mI -= n; return *this;};
+			node_iterator operator+(difference_type n) const {return node_iterator(mC, mI+n);};
+			node_iterator operator-(difference_type n) const {return node_iterator(mC, mI-n);};
+			friend node_iterator operator+(difference_type n, const node_iterator & it) {return it + n;};
+			difference_type operator-(const node_iterator & it) const {return difference_type(mI) - difference_type(it.mI);};
+
+			bool operator==(const node_iterator & it) const {return mI == it.mI;};
+			bool operator!=(const node_iterator & it) const {return mI != it.mI;};
+			bool operator<(const node_iterator & it) const {return mI < it.mI;};
+			bool operator>(const node_iterator & it) const {return mI > it.mI;};
+			bool operator<=(const node_iterator & it) const {return mI <= it.mI;};
+			bool operator>=(const node_iterator & it) const {return mI >= it.mI;};
+
+			size_type index() const {return mI;};
+			container_type * container() const {return mC;};
+
+		private:
+			container_type * 	mC;
+			size_type 			mI;
+		};
+
+		typedef node_value 						value_type;
+		typedef node_reference<false> 			reference;
+		typedef node_reference<true> 			const_reference;
+		typedef node_iterator<false> 			iterator;
+		typedef node_iterator<true> 			const_iterator;
+
+
+
+		// the node container of a GenericMesh
+		soa_node_container & nodes() {return *this;};
+		const soa_node_container & nodes() const {return *this;};
+
+		iterator begin() {return iterator(this, 0);};
+		iterator end() {return iterator(this, size());};
+		const_iterator begin() const {return const_iterator(this, 0);};
+		const_iterator end() const {return const_iterator(this, size());};
+		const_iterator cbegin() const {return begin();};
+		const_iterator cend() const {return end();};
+
+		reference operator[](size_type i) {return reference(this, i);};
+		const_reference operator[](size_type i) const {return const_reference(this, i);};
+
+		reference at(size_type i){
+			if (i >= size()) throw std::out_of_range("soa_node_container::at");
+			return reference(this, i);
+		}
+
+		const_reference at(size_type i) const {
+			if (i >= size()) throw std::out_of_range("soa_node_container::at");
+			return const_reference(this, i);
+		}
+
+		reference front() {return reference(this, 0);};
+		reference back() {return reference(this, size()-1);};
+
+		size_type size() const {return mCoords[0].size();};
+		bool empty() const {return mCoords[0].empty();};
+
+		// new nodes are value-initialized
+		void resize(size_type n) {apply([n](auto & a){a.resize(n, typename std::decay_t<decltype(a)>::value_type());});};
+		void reserve(size_type n) {apply([n](auto & a){a.reserve(n);});};
+		void clear() {apply([](auto & a){a.clear();});};
+		void pop_back() {apply([](auto & a){a.pop_back();});};
+
+		void push_back(const node_value & v){
+			for (std::size_t d=0; d<Dim; d++) mCoords[d].push_back(v.mCoords[d]);
+			append(v.mFields, field_indices());
+		}
+
+		void emplace_back(const std::array<T, Dim> & c, const Fields & ... f) {push_back(node_value(c, f...));};
+
+		// resize to n nodes, with new nodes set to v. Each thread of the team
+		// writes its static_partition slice of every array, which is the slice
+		// it gets in for_each_parallel, so the pages of every component end up
+		// on the socket of the thread that works on them (see Numa.hpp)
+		template <typename Team>
+		void first_touch_resize(Team & team, size_type n, const node_value & v = node_value()){
+			const size_type old = size();
+			apply([n](auto & a){a.resize(n);});
+			if (n <= old) return;
+			const int nthreads = team.num_threads();
+			team.run([&](int tid){
+				IndexRange r = static_partition(n, tid, nthreads);
+				for (std::size_t d=0; d<Dim; d++){
+					for (size_type i=std::max(r.first, old); i<r.last; i++) mCoords[d][i] = v.mCoords[d];
+				}
+				for (size_type i=std::max(r.first, old); i<r.last; i++) scatter(i, v.mFields, field_indices());
+			});
+		}
+
+		void first_touch_resize(size_type n, const node_value & v = node_value()){
+			OmpTeam team;
+			first_touch_resize(team, n, v);
+		}
+
+
+
+		// the arrays of each component, e.g. for vectorized kernels
+		aligned_vector<T> & coordinate(std::size_t d) {return mCoords[d];};
+		const aligned_vector<T> & coordinate(std::size_t d) const {return mCoords[d];};
+
+		template <std::size_t I>
+		aligned_vector<field_type<I>> & field() {return std::get<I>(mFields);};
+		template <std::size_t I>
+		const aligned_vector<field_type<I>> & field() const {return std::get<I>(mFields);};
+
+	private:
+		std::array<aligned_vector<T>, Dim> 		mCoords;
+		field_arrays 							mFields;
+
+		// call f on every array
+		template <typename Functor>
+		void apply(Functor f){
+			for (std::size_t d=0; d<Dim; d++) f(mCoords[d]);
+			apply_fields(f, field_indices());
+		}
+
+		template <typename Functor, std::size_t... Is>
+		void apply_fields(Functor & f, std::index_sequence<Is...>){
+			int expand[] = {0, (f(std::get<Is>(mFields)), 0)...};
+			(void)expand;
+		}
+
+		template <std::size_t... Is>
+		void append(const field_tuple & v, std::index_sequence<Is...>){
+			int expand[] = {0, (std::get<Is>(mFields).push_back(std::get<Is>(v)), 0)...};
+			(void)expand;
+		}
+
+		template <std::size_t... Is>
+		void gather(size_type i, field_tuple & v, std::index_sequence<Is...>) const {
+			int expand[] = {0, (std::get<Is>(v) = std::get<Is>(mFields)[i], 0)...};
+			(void)expand;
+		}
+
+		template <std::size_t... Is>
+		void scatter(size_type i, const field_tuple & v, std::index_sequence<Is...>){
+			int expand[] = {0, (std::get<Is>(mFields)[i] = std::get<Is>(v), 0)...};
+			(void)expand;
+		}
+	};
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,224 @@
+/** @file TaskGraph.hpp
+ *  @brief file with the TaskGraph class
+ *
+ *  This contains the TaskGraph class, a lightweight
+ *  dependency graph of kernels with declared read and
+ *  write fields, executed on a ThreadPool as soon as
+ *  each kernel's dependencies are done
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _TASKGRAPH_H
+#define _TASKGRAPH_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+
+#include "ForEach.hpp"
+#include "ThreadPool.hpp"
+
+namespace simbox{
+
+
+	/** @class TaskGraph
+	 *  @brief a DAG of kernels ordered by the fields they read and write
+	 *
+	 *  Tasks are added in program order, each with the fields it reads and
+	 *  writes. Fields are identified by address, so any object (a vector,
+	 *  a MultiSetContainer, an output buffer...) can be declared. A task
+	 *  depends on the last writer of every field it reads or writes, and
+	 *  a writer also depends on every reader since the previous write.
+	 *  Running the graph therefore gives the same result as running the
+	 *  tasks in the order they were added, while independent tasks (e.g.
+	 *  output staging and the next field update) overlap.
+	 *
+	 *  A graph can be run any number of times, e.g. once per time step.
+	 *  Each task runs on a single pool thread. A kernel that needs data
+	 *  parallelism inside its task can open its own omp team, which is
+	 *  what add_for_each_parallel does, but must not run on the pool
+	 *  that runs the graph: any loop on that pool throws std::logic_error,
+	 *  whatever the size of the pool or of the loop.
+	 *
+	 */
+	class TaskGraph{
+	public:
+		typedef std::size_t 				task_id;
+		typedef const void * 				field_id;
+
+		// add a task and return its id
+		//
+		// e.g.:	g.add([&](){update(E, H);}, {&E, &H}, {&E}, "update E");
+		task_id add(std::function<void()> f,
+					std::initializer_list<field_id> reads,
+					std::initializer_list<field_id> writes,
+					std::string name = ""){
+			task_id id = mTasks.size();
+			mTasks.push_back(Task{f, name, {}, 0});
+
+			for (auto r=reads.begin(); r!=reads.end(); r++){
+				FieldState & fs = mFields[*r];
+				if (fs.has_writer) depend(fs.writer, id);
+				fs.readers.push_back(id);
+			}
+			for (auto w=writes.begin(); w!=writes.end(); w++){
+				FieldState & fs = mFields[*w];
+				if (fs.has_writer) depend(fs.writer, id);
+				for (auto r=fs.readers.begin(); r!=fs.readers.end(); r++) depend(*r, id);
+				fs.readers.clear();
+				fs.writer = id;
+				fs.has_writer = true;
+			}
+			return id;
+		}
+
+		// add a serial for_each kernel over [beg, end) as a task. The name
+		// comes before the arguments of the functor
+		//
+		// e.g.:	g.add_for_each<MyPolicy>(E.begin(), E.end(), Update(), {&E, &H}, {&E}, "update E", dt);
+		template <class InterfacePolicy,
+				  class IteratorType,
+				  class Functor,
+				  typename... Args>
+		task_id add_for_each(IteratorType beg, IteratorType end, Functor u,
+							 std::initializer_list<field_id> reads,
+							 std::initializer_list<field_id> writes,
+							 std::string name,
+							 Args... a){
+			return add([beg, end, u, a...](){for_each<InterfacePolicy>(beg, end, u, a...);}, reads, writes, name);
+		}
+
+		// add a for_each_parallel kernel over [beg, end) as a task. The
+		// loop runs on an omp team of its own (see for_each_parallel), so
+		// a large kernel keeps its data parallelism. Tasks that overlap
+		// with it share the cores
+		//
+		// e.g.:	g.add_for_each_parallel<MyPolicy>(E.begin(), E.end(), Update(), {&E, &H}, {&E}, "update E", dt);
+		template <class InterfacePolicy,
+				  class IteratorType,
+				  class Functor,
+				  typename... Args>
+		task_id add_for_each_parallel(IteratorType beg, IteratorType end, Functor u,
+									  std::initializer_list<field_id> reads,
+									  std::initializer_list<field_id> writes,
+									  std::string name,
+									  Args... a){
+			return add([beg, end, u, a...](){for_each_parallel<InterfacePolicy>(beg, end, u, a...);}, reads, writes, name);
+		}
+
+		std::size_t size() const {return mTasks.size();};
+
+		const std::string & name(task_id t) const {return mTasks[t].name;};
+
+		// remove every task and field
+		void clear(){
+			mTasks.clear();
+			mFields.clear();
+		}
+
+		// run every task on the calling thread, in the order added
+		void run_serial() const {
+			for (auto it=mTasks.begin(); it!=mTasks.end(); it++) it->func();
+		}
+
+		// run the graph on a thread pool. Returns once every task is done.
+		// Threads with no ready task sleep until a task finishes. If tasks
+		// throw, the first exception is rethrown after the remaining tasks
+		// have run
+		void run(ThreadPool & pool = ThreadPool::instance()) const {
+			if (mTasks.empty()) return;
+
+			// the queue, the counts of unfinished predecessors and the
+			// number of finished tasks are guarded by qmutex
+			std::vector<std::size_t> pending(mTasks.size());
+			std::deque<task_id> ready;
+			for (task_id t=0; t<mTasks.size(); t++){
+				pending[t] = mTasks[t].npred;
+				if (mTasks[t].npred == 0) ready.push_back(t);
+			}
+
+			std::mutex qmutex;
+			std::condition_variable qcond;
+			std::size_t done = 0;
+			std::exception_ptr error;
+
+			pool.run([&](int){
+				std::unique_lock<std::mutex> lock(qmutex);
+				while (true){
+					qcond.wait(lock, [&](){return !ready.empty() || done == mTasks.size();});
+					if (ready.empty()) return;
+					const task_id t = ready.front();
+					ready.pop_front();
+					lock.unlock();
+
+					std::exception_ptr e;
+					try {mTasks[t].func();}
+					catch (...) {e = std::current_exception();}
+
+					lock.lock();
+					if (e && !error) error = e;
+					std::size_t woken = 0;
+					for (auto s=mTasks[t].succ.begin(); s!=mTasks[t].succ.end(); s++){
+						if (--pending[*s] == 0){
+							ready.push_back(*s);
+							woken++;
+						}
+					}
+					done++;
+					// this thread takes one of the new tasks itself
+					if (done == mTasks.size() || woken > 1) qcond.notify_all();
+				}
+			});
+
+			if (error) std::rethrow_exception(error);
+		}
+
+		void print_summary(std::ostream & os = std::cout) const {
+			os << "<TaskGraph tasks=\"" << mTasks.size() << "\" fields=\"" << mFields.size() << "\">" << std::endl;
+			for (task_id t=0; t<mTasks.size(); t++){
+				os << "\t<Task id=\"" << t << "\" name=\"" << mTasks[t].name << "\" successors=\"";
+				for (auto s=mTasks[t].succ.begin(); s!=mTasks[t].succ.end(); s++) os << *s << " ";
+				os << "\"/>" << std::endl;
+			}
+			os << "</TaskGraph>" << std::endl;
+		}
+
+	private:
+		struct Task{
+			std::function<void()> 		func;
+			std::string 				name;
+			std::vector<task_id> 		succ;
+			std::size_t 				npred;
+		};
+
+		struct FieldState{
+			bool 						has_writer = false;
+			task_id 					writer = 0;
+			std::vector<task_id> 		readers;
+		};
+
+		// "to" depends on "from"
+		void depend(task_id from, task_id to){
+			if (from == to) return;
+			std::vector<task_id> & succ = mTasks[from].succ;
+			if (!succ.empty() && succ.back() == to) return;
+			succ.push_back(to);
+			mTasks[to].npred++;
+		}
+
+		std::vector<Task> 						mTasks;
+		std::map<field_id, FieldState> 			mFields;
+	};
+
+
+} // end namespace simbox
+#endif
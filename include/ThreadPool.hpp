@@ -0,0 +1,194 @@
+/** @file ThreadPool.hpp
+ *  @brief file with the ThreadPool class
+ *
+ *  This contains a persistent, optionally pinned, pool
+ *  of worker threads that runs fork-join jobs without
+ *  opening a new parallel region for every loop
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include <exception>
+
+#include <omp.h>
+
+#include "Numa.hpp"
+
+namespace simbox{
+
+
+	/** @class ThreadPool
+	 *  @brief a persistent team of worker threads for fork-join jobs
+	 *
+	 *  The calling thread takes part in every job as thread 0, and
+	 *  nthreads-1 workers are started once and kept alive. A job is
+	 *  published by bumping an epoch counter; workers spin on it for a
+	 *  while before falling asleep on a condition variable, so that
+	 *  back-to-back loops dispatch without a system call (the caller
+	 *  only notifies when some worker is actually asleep). The caller
+	 *  waits on a barrier counter until every worker has finished.
+	 *
+	 *  Jobs submitted from different threads (e.g. a for_each_async
+	 *  task and the main loop) run one after the other. A job submitted
+	 *  from inside a job of the same pool could never start, so run()
+	 *  throws std::logic_error instead.
+	 *
+	 *  If f throws on any thread, the job still waits for every thread
+	 *  to finish, and run() then rethrows the first exception.
+	 *
+	 */
+	class ThreadPool{
+	public:
+		// nthreads of 0 uses omp_get_max_threads(). The workers are pinned
+		// according to the affinity (see Numa.hpp). The calling thread is
+		// left alone, since pinning it would also confine every thread it
+		// starts later (e.g. the omp team), and cpu 0 is kept free for it
+		ThreadPool(int nthreads = 0, Affinity affinity = Affinity::NONE, unsigned int spin = 20000)
+		: mThreads(nthreads > 0 ? nthreads : omp_get_max_threads()), mSpin(spin),
+		  mEpoch(0), mPending(0), mSleeping(0), mStop(false), mJob(nullptr) {
+			for (int t=1; t<mThreads; t++){
+				mWorkers.emplace_back([this, t, affinity](){
+					if (affinity != Affinity::NONE) pin_this_thread(affinity_cpu(affinity, t, mThreads));
+					worker(t);
+				});
+			}
+		};
+
+		~ThreadPool(){
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStop = true;
+				mEpoch.fetch_add(1, std::memory_order_release);
+			}
+			mWake.notify_all();
+			for (auto it=mWorkers.begin(); it!=mWorkers.end(); it++) it->join();
+		};
+
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool & operator=(const ThreadPool &) = delete;
+
+		int num_threads() const {return mThreads;};
+
+		// true if the calling thread is running a job of this pool
+		bool in_job() const {return current() == this;};
+
+		// run f(tid) on every thread of the pool (tid in [0, num_threads()))
+		// and return once all of them are done
+		template <typename TeamFunctor>
+		void run(TeamFunctor && f){
+			if (in_job()) throw std::logic_error("ThreadPool::run: called from inside a job of the same pool");
+
+			std::lock_guard<std::mutex> runlock(mRunMutex);
+			CurrentGuard guard(this);
+			if (mThreads == 1){
+				f(0);
+				return;
+			}
+
+			std::function<void(int)> job(std::ref(f));
+			mError = nullptr;
+			mJob = &job;
+			mPending.store(mThreads-1, std::memory_order_relaxed);
+			mEpoch.fetch_add(1);
+
+			// only take the lock if a worker has gone to sleep
+			if (mSleeping.load() > 0){
+				{std::lock_guard<std::mutex> lock(mMutex);}
+				mWake.notify_all();
+			}
+
+			try {f(0);}
+			catch (...) {set_error(std::current_exception());}
+
+			// barrier: wait for the workers to finish, even if f threw, since
+			// they still use the job
+			for (unsigned int i=0; mPending.load(std::memory_order_acquire) > 0; i++){
+				if (i > mSpin) std::this_thread::yield();
+			}
+			mJob = nullptr;
+			if (mError){
+				std::exception_ptr e = mError;
+				mError = nullptr;
+				std::rethrow_exception(e);
+			}
+		}
+
+		// a process-wide pool, created on first use with default arguments
+		static ThreadPool & instance(){
+			static ThreadPool pool;
+			return pool;
+		}
+
+	private:
+		// the pool whose job the calling thread is running, if any
+		static ThreadPool *& current(){
+			static thread_local ThreadPool * pool = nullptr;
+			return pool;
+		}
+
+		// a job of another pool may be running on this thread, so
+		// the previous pool is restored on exit
+		struct CurrentGuard{
+			ThreadPool * previous;
+			CurrentGuard(ThreadPool * p) : previous(current()) {current() = p;};
+			~CurrentGuard() {current() = previous;};
+		};
+
+		// keep the first exception thrown by a job
+		void set_error(std::exception_ptr e){
+			std::lock_guard<std::mutex> lock(mErrorMutex);
+			if (!mError) mError = e;
+		}
+
+		void worker(int tid){
+			current() = this;
+			std::size_t seen = 0;
+			while (true){
+				// spin, then sleep, until a new epoch is published
+				unsigned int i = 0;
+				while (mEpoch.load(std::memory_order_acquire) == seen && i < mSpin) i++;
+				if (mEpoch.load(std::memory_order_acquire) == seen){
+					std::unique_lock<std::mutex> lock(mMutex);
+					mSleeping++;
+					mWake.wait(lock, [this, seen](){return mEpoch.load() != seen;});
+					mSleeping--;
+				}
+				seen = mEpoch.load(std::memory_order_acquire);
+				if (mStop) return;
+
+				try {(*mJob)(tid);}
+				catch (...) {set_error(std::current_exception());}
+				mPending.fetch_sub(1, std::memory_order_acq_rel);
+			}
+		}
+
+		int 								mThreads;
+		unsigned int 						mSpin;
+		std::vector<std::thread> 			mWorkers;
+
+		std::mutex 							mMutex;
+		std::mutex 							mRunMutex;
+		std::mutex 							mErrorMutex;
+		std::condition_variable 			mWake;
+		std::atomic<std::size_t> 			mEpoch;
+		std::atomic<int> 					mPending;
+		std::atomic<int> 					mSleeping;
+		bool 								mStop;
+		std::function<void(int)> * 			mJob;
+		std::exception_ptr 					mError;
+	};
+
+
+} // end namespace simbox
+#endif
@@ -0,0 +1,217 @@
+/** @file WorkStealing.hpp
+ *  @brief file with the WorkStealingExecutor class
+ *
+ *  This contains the WorkStealingExecutor class, which
+ *  runs a range functor over [0, n) using recursive range
+ *  splitting and per-thread deques
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _WORKSTEALING_H
+#define _WORKSTEALING_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#include <omp.h>
+
+namespace simbox{
+
+
+	// a half-open range of indices [first, last)
+	struct IndexRange{
+		std::size_t first;
+		std::size_t last;
+
+		std::size_t size() const {return last - first;};
+	};
+
+
+	// the contiguous slice of [0, n) that belongs to thread "tid" out
+	// of "nthreads" under a static partition. This is the partition
+	// that work-stealing loops start from before any stealing happens
+	inline IndexRange static_partition(std::size_t n, int tid, int nthreads){
+		return IndexRange{n*tid/nthreads, n*(tid+1)/nthreads};
+	}
+
+
+
+	/** @class RangeDeque
+	 *  @brief a deque of index ranges owned by a single thread
+	 *
+	 *  The owner pushes and pops at the back (depth-first, so the
+	 *  owner keeps working on the most recently split, cache-warm piece).
+	 *  Thieves steal from the front, where the largest ranges sit.
+	 *
+	 */
+	class alignas(64) RangeDeque{
+	public:
+		void push(IndexRange r){
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQueue.push_back(r);
+		}
+
+		bool pop(IndexRange & r){
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mQueue.empty()) return false;
+			r = mQueue.back();
+			mQueue.pop_back();
+			return true;
+		}
+
+		bool steal(IndexRange & r){
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mQueue.empty()) return false;
+			r = mQueue.front();
+			mQueue.pop_front();
+			return true;
+		}
+
+	private:
+		std::mutex 					mMutex;
+		std::deque<IndexRange> 		mQueue;
+	};
+
+
+
+	// the team of threads of an omp parallel region
+	struct OmpTeam{
+		int 		nthreads;
+
+		OmpTeam(int n = 0)
+		: nthreads(n > 0 ? n : omp_get_max_threads()) {};
+
+		int num_threads() const {return nthreads;};
+
+		// run f(tid) for every tid in [0, nthreads). If the runtime starts
+		// fewer threads (e.g. inside another parallel region), some
+		// threads run several tids in turn
+		template <typename TeamFunctor>
+		void run(TeamFunctor && f) const {
+			#pragma omp parallel num_threads(nthreads)
+			{
+				for (int t=omp_get_thread_num(); t<nthreads; t+=omp_get_num_threads()) f(t);
+			}
+		}
+	};
+
+
+
+	namespace Detail{
+		// true if the calling thread is running a job of the team. Only
+		// teams that cannot nest (ThreadPool) have in_job()
+		template <typename Team>
+		auto in_team_job(const Team & team, int) -> decltype(team.in_job()) {return team.in_job();};
+
+		template <typename Team>
+		bool in_team_job(const Team &, long) {return false;};
+	} // end namespace Detail
+
+
+
+	/** @class WorkStealingExecutor
+	 *  @brief runs a range functor over [0, n) with work stealing
+	 *
+	 *  Each thread is seeded with its static_partition slice of the
+	 *  range. A thread repeatedly splits its current range in half,
+	 *  pushing the upper half onto its own deque, until the piece is no
+	 *  larger than the grain size, then runs the functor on it. Threads
+	 *  that run out of work steal from the other deques.
+	 *
+	 *  The range functor is called as f(first, last) on disjoint pieces
+	 *  that together cover [0, n) exactly once.
+	 *
+	 */
+	class WorkStealingExecutor{
+	public:
+		// a grain of 0 chooses a grain from the range size and thread count.
+		// nthreads of 0 uses omp_get_max_threads()
+		WorkStealingExecutor(std::size_t grain = 0, int nthreads = 0)
+		: mGrain(grain), mThreads(nthreads > 0 ? nthreads : omp_get_max_threads()) {};
+
+		int num_threads() const {return mThreads;};
+
+		// grain size used for a range of size n
+		std::size_t grain(std::size_t n) const {
+			if (mGrain > 0) return mGrain;
+			return std::max<std::size_t>(1, n/(8*mThreads));
+		}
+
+		template <typename RangeFunctor>
+		void run(std::size_t n, RangeFunctor && f) const {
+			OmpTeam team(mThreads);
+			run(team, n, f);
+		}
+
+		// run on a given team of threads (e.g. a ThreadPool). The team must
+		// provide num_threads() and run(g), which calls g(tid) on every thread.
+		// Small ranges run on the calling thread, but are refused like any
+		// other where team.run() would refuse them
+		template <typename Team, typename RangeFunctor>
+		void run(Team & team, std::size_t n, RangeFunctor && f) const {
+			if (Detail::in_team_job(team, 0)) throw std::logic_error("WorkStealingExecutor::run: called from inside a job of the same team");
+			if (n == 0) return;
+
+			const int nthreads = team.num_threads();
+			std::size_t g = (mGrain > 0 ? mGrain : std::max<std::size_t>(1, n/(8*nthreads)));
+			if (nthreads == 1 || n <= g){
+				f(std::size_t(0), n);
+				return;
+			}
+
+			std::vector<RangeDeque> queues(nthreads);
+			for (int t=0; t<nthreads; t++){
+				IndexRange r = static_partition(n, t, nthreads);
+				if (r.size() > 0) queues[t].push(r);
+			}
+			std::atomic<std::size_t> remaining(n);
+
+			team.run([&](int tid){
+				work(tid, queues, remaining, g, f);
+			});
+		}
+
+		// the per-thread work loop
+		template <typename RangeFunctor>
+		static void work(int tid, std::vector<RangeDeque> & queues,
+						 std::atomic<std::size_t> & remaining,
+						 std::size_t g, RangeFunctor & f){
+			const int nq = queues.size();
+			IndexRange r;
+			while (remaining.load(std::memory_order_acquire) > 0){
+				bool found = queues[tid % nq].pop(r);
+				for (int v=1; !found && v<nq; v++){
+					found = queues[(tid+v) % nq].steal(r);
+				}
+				if (!found){
+					std::this_thread::yield();
+					continue;
+				}
+
+				// split until the piece is small enough to run
+				while (r.size() > g){
+					std::size_t mid = r.first + r.size()/2;
+					queues[tid % nq].push(IndexRange{mid, r.last});
+					r.last = mid;
+				}
+
+				f(r.first, r.last);
+				remaining.fetch_sub(r.size(), std::memory_order_acq_rel);
+			}
+		}
+
+	private:
+		std::size_t 		mGrain;
+		int 				mThreads;
+	};
+
+
+} // end namespace simbox
+#endif
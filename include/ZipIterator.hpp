@@ -3,6 +3,8 @@
 
 
 #include <tuple>
+#include <utility>
+#include <iterator>
 #include <type_traits>
 
 #include "Detail.hpp"
@@ -74,53 +76,177 @@ namespace simbox{
 
 
 
+// the tuple of references returned when dereferencing a ZipIterator.
+// Assigning to it writes through to the zipped containers, and two
+// of them can be swapped, so std algorithms that permute elements
+// (e.g. std::sort) move every zipped array together
+template <typename... References>
+class ZipReference : public std::tuple<References...>{
+public:
+	typedef std::tuple<References...> 										base_type;
+	typedef std::tuple<typename std::decay<References>::type...> 			value_type;
+
+	using base_type::base_type;
+
+	ZipReference(const ZipReference & r)
+	: base_type(static_cast<const base_type &>(r)) {};
+
+	// assignment writes through the references
+	ZipReference & operator=(const ZipReference & r){
+		base_type::operator=(static_cast<const base_type &>(r));
+		return *this;
+	};
+
+	ZipReference & operator=(ZipReference && r){
+		base_type::operator=(static_cast<const base_type &>(r));
+		return *this;
+	};
+
+	template <typename... Ts>
+	ZipReference & operator=(const std::tuple<Ts...> & t){
+		base_type::operator=(t);
+		return *this;
+	};
+
+	template <typename... Ts>
+	ZipReference & operator=(std::tuple<Ts...> && t){
+		base_type::operator=(std::move(t));
+		return *this;
+	};
+
+	// swap the referenced values, not the references
+	friend void swap(ZipReference a, ZipReference b){
+		Detail::for_each(static_cast<base_type &>(a), static_cast<base_type &>(b), [](auto & x, auto & y){
+			using std::swap;
+			swap(x, y);
+		});
+	};
+};
+
+
+
+namespace Detail{
+	// weakest iterator category of a list of iterators
+	template <typename... Iterators>
+	struct common_iterator_category;
+
+	template <typename Iterator>
+	struct common_iterator_category<Iterator>{
+		typedef typename std::iterator_traits<Iterator>::iterator_category type;
+	};
+
+	template <typename Iterator, typename... Iterators>
+	struct common_iterator_category<Iterator, Iterators...>{
+		typedef typename std::iterator_traits<Iterator>::iterator_category 		first;
+		typedef typename common_iterator_category<Iterators...>::type 			rest;
+		typedef typename std::conditional<std::is_base_of<first, rest>::value, first, rest>::type type;
+	};
+
+
+	template <typename IteratorTuple>
+	struct zip_traits;
+
+	template <typename... Iterators>
+	struct zip_traits<std::tuple<Iterators...>>{
+		typedef ZipReference<typename std::iterator_traits<Iterators>::reference...> 		reference;
+		typedef typename reference::value_type 												value_type;
+		typedef typename common_iterator_category<Iterators...>::type 						iterator_category;
+		typedef typename std::iterator_traits<
+					typename std::tuple_element<0, std::tuple<Iterators...>>::type
+				>::difference_type 															difference_type;
+	};
+
+	template <typename Reference, typename IteratorTuple, std::size_t... Is>
+	Reference make_zip_reference(const IteratorTuple & t, std::index_sequence<Is...>){
+		return Reference(*std::get<Is>(t)...);
+	}
+} // end namespace Detail
+
+
+
+
+// iterate over several containers at once. The category is the weakest
+// category of the zipped iterators, so zipping random access iterators
+// gives a random access iterator that works with for_each_parallel and
+// std::sort. Differences and comparisons use the first iterator
 template <typename IteratorTuple>
 class ZipIterator{
 public:
-	typedef ZipIterator 					self_type;
-	typedef	typename Detail::element_replace_all_ref<IteratorTuple>::type 	reference;
-    typedef	reference											value_type;
-    typedef	value_type *										pointer;
-    typedef typename std::tuple_element<0, IteratorTuple>::type::difference_type	difference_type;
-    typedef typename std::tuple_element<0, IteratorTuple>::type::iterator_category	iterator_category;
+	typedef ZipIterator 												self_type;
+	typedef typename Detail::zip_traits<IteratorTuple>::reference 			reference;
+	typedef typename Detail::zip_traits<IteratorTuple>::value_type 			value_type;
+	typedef reference *													pointer;
+	typedef typename Detail::zip_traits<IteratorTuple>::difference_type 	difference_type;
+	typedef typename Detail::zip_traits<IteratorTuple>::iterator_category 	iterator_category;
 
 
-    ZipIterator(){};
+	ZipIterator(){};
 
-    ZipIterator(IteratorTuple t)
-    : mtup(t) {};
+	ZipIterator(IteratorTuple t)
+	: mtup(t) {};
 
 
-    // dereferencing
-	constexpr reference operator*(){
-		return Detail::make_tuple_ref(mtup);
+	// dereferencing
+	reference operator*() const {
+		return Detail::make_zip_reference<reference>(mtup, std::make_index_sequence<std::tuple_size<IteratorTuple>::value>());
 	};
 
+	// random access
+	reference operator[](difference_type n) const {return *(*this + n);};
 
-	// accessing a given iterator in the zipped container
-	template <std::size_t I>
-	typename std::tuple_element<I, IteratorTuple>::type & 
-	get() {return *std::get<I>(mtup);};
 
-	// accessing a given iterator in the zipped container
+	// accessing a given element in the zipped container
 	template <std::size_t I>
-	const typename std::tuple_element<I, IteratorTuple>::type & 
+	typename std::iterator_traits<typename std::tuple_element<I, IteratorTuple>::type>::reference
 	get() const {return *std::get<I>(mtup);};
 
+	// the underlying iterators
+	const IteratorTuple & iterators() const {return mtup;};
+
 	// preincrement 
-	self_type operator++(){
+	self_type & operator++(){
 	 	Detail::for_each(mtup, [](auto & c){++c;});
 		return *this;
 	};
 
 	// postincrement 
 	self_type operator++(int blah){
-		Detail::for_each(mtup, [](auto & c){c++;});
+		self_type out(*this);
+		++(*this);
+		return out;
+	};
+
+	// predecrement 
+	self_type & operator--(){
+	 	Detail::for_each(mtup, [](auto & c){--c;});
 		return *this;
 	};
 
-	// pointer
-	pointer operator->() {return &this->operator*();};
+	// postdecrement 
+	self_type operator--(int blah){
+		self_type out(*this);
+		--(*this);
+		return out;
+	};
+
+	self_type & operator+=(difference_type n){
+		Detail::for_each(mtup, [n](auto & c){c += n;});
+		return *this;
+	};
+
+	self_type & operator-=(difference_type n){
+		Detail::for_each(mtup, [n](auto & c){c -= n;});
+		return *this;
+	};
+
+	self_type operator+(difference_type n) const {self_type out(*this); return out += n;};
+	self_type operator-(difference_type n) const {self_type out(*this); return out -= n;};
+	friend self_type operator+(difference_type n, const self_type & it) {return it + n;};
+
+	// distance
+	difference_type operator-(const self_type & it) const {
+		return std::get<0>(mtup) - std::get<0>(it.mtup);
+	};
 
 	// inequality
 	bool operator!=(const self_type & leaf) const {
@@ -132,6 +258,12 @@ public:
 		return mtup == leaf.mtup;
 	};
 
+	// ordering
+	bool operator<(const self_type & it) const {return std::get<0>(mtup) < std::get<0>(it.mtup);};
+	bool operator>(const self_type & it) const {return it < *this;};
+	bool operator<=(const self_type & it) const {return !(it < *this);};
+	bool operator>=(const self_type & it) const {return !(*this < it);};
+
 
 private:
 	IteratorTuple			mtup;
@@ -157,4 +289,17 @@ ZipIterator<std::tuple<Iterator...>> make_zip_iterator(Iterator... it){
 
 } // end namespace simbox
 
+
+
+// a ZipReference is tuple-like
+namespace std{
+	template <typename... References>
+	struct tuple_size<simbox::ZipReference<References...>>
+	: public tuple_size<tuple<References...>> {};
+
+	template <size_t I, typename... References>
+	struct tuple_element<I, simbox::ZipReference<References...>>
+	: public tuple_element<I, tuple<References...>> {};
+}
+
 #endif
\ No newline at end of file
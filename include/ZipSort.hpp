@@ -0,0 +1,289 @@
+/** @file ZipSort.hpp
+ *  @brief file with sorting of zipped parallel arrays
+ *
+ *  This contains zip_sort, which reorders parallel arrays
+ *  (zipped with make_zip_iterator) by one of their components,
+ *  sort_permutation and apply_permutation. Integer keys
+ *  use a parallel radix sort
+ *
+ *  @author D. Pederson
+ *  @bug No known bugs.
+ */
+
+#ifndef _ZIPSORT_H
+#define _ZIPSORT_H
+
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "ZipIterator.hpp"
+#include "WorkStealing.hpp"
+
+namespace simbox{
+
+
+	namespace Detail{
+		// type of the K-th component of a zipped range
+		template <std::size_t K, class IteratorType>
+		struct zip_key{
+			typedef typename std::decay<
+						typename std::tuple_element<K, typename std::iterator_traits<IteratorType>::value_type>::type
+					>::type 	type;
+		};
+
+		// keys that can be radix sorted
+		template <typename T>
+		struct is_radix_key{
+			static constexpr bool value = std::is_integral<T>::value && !std::is_same<T, bool>::value;
+		};
+
+		// map an integer to an unsigned integer with the same ordering
+		template <typename T>
+		typename std::make_unsigned<T>::type radix_key(T k){
+			typedef typename std::make_unsigned<T>::type U;
+			return std::is_signed<T>::value ? U(U(k) ^ (U(1) << (8*sizeof(T)-1))) : U(k);
+		}
+
+
+
+		// stable LSD radix sort of (key, index) pairs, 8 bits per pass. Every
+		// thread counts and then scatters its own static_partition slice, so
+		// the sort is stable. Passes where every key has the same digit are
+		// skipped, so small keys in wide types only cost a histogram
+		template <typename Team, typename U>
+		void radix_sort_pairs(Team & team, std::vector<U> & keys, std::vector<std::size_t> & idx){
+			const std::size_t n = keys.size();
+			const int nthreads = team.num_threads();
+			std::vector<U> 				keys2(n);
+			std::vector<std::size_t> 	idx2(n);
+			std::vector<std::size_t> 	counts(256*nthreads);
+
+			for (unsigned int shift=0; shift<8*sizeof(U); shift+=8){
+				std::fill(counts.begin(), counts.end(), 0);
+				team.run([&](int tid){
+					IndexRange r = static_partition(n, tid, nthreads);
+					std::size_t * c = &counts[256*tid];
+					for (std::size_t i=r.first; i<r.last; i++) c[(keys[i] >> shift) & 0xff]++;
+				});
+
+				// skip the pass if all keys share this digit
+				bool trivial = false;
+				for (unsigned int d=0; d<256 && !trivial; d++){
+					std::size_t tot = 0;
+					for (int t=0; t<nthreads; t++) tot += counts[256*t+d];
+					trivial = (tot == n);
+				}
+				if (trivial) continue;
+
+				// exclusive prefix sum in (digit, thread) order
+				std::size_t sum = 0;
+				for (unsigned int d=0; d<256; d++){
+					for (int t=0; t<nthreads; t++){
+						std::size_t c = counts[256*t+d];
+						counts[256*t+d] = sum;
+						sum += c;
+					}
+				}
+
+				team.run([&](int tid){
+					IndexRange r = static_partition(n, tid, nthreads);
+					std::size_t * c = &counts[256*tid];
+					for (std::size_t i=r.first; i<r.last; i++){
+						std::size_t pos = c[(keys[i] >> shift) & 0xff]++;
+						keys2[pos] = keys[i];
+						idx2[pos] = idx[i];
+					}
+				});
+				keys.swap(keys2);
+				idx.swap(idx2);
+			}
+		}
+
+
+
+		// the number of elements taken from "a" by the first d elements of
+		// the stable merge of a and b (the merge path split of SetAlgebra.hpp)
+		template <typename T, typename Compare>
+		std::size_t merge_path(const T * a, std::size_t na, const T * b, std::size_t nb, std::size_t d, Compare less){
+			std::size_t lo = d > nb ? d - nb : 0;
+			std::size_t hi = std::min(d, na);
+			while (lo < hi){
+				std::size_t mid = (lo + hi)/2;
+				if (!less(b[d-mid-1], a[mid])) lo = mid+1;
+				else hi = mid;
+			}
+			return lo;
+		}
+
+		// stable comparison sort of (key, index) pairs. Every thread sorts its
+		// static_partition slice, and neighbouring slices are then merged in
+		// rounds. In every round each merge is split by merge path between
+		// all the threads whose slices it covers, so the last merge is as
+		// parallel as the first. Ties are broken by index, which makes it
+		// stable. The team must call f(tid) for every tid
+		template <typename Team, typename KeyType, typename Compare>
+		void merge_sort_pairs(Team & team, std::vector<std::pair<KeyType, std::size_t>> & pairs, Compare comp){
+			typedef std::pair<KeyType, std::size_t> 	pair_type;
+			auto less = [&comp](const pair_type & a, const pair_type & b){
+				if (comp(a.first, b.first)) return true;
+				if (comp(b.first, a.first)) return false;
+				return a.second < b.second;
+			};
+
+			const std::size_t n = pairs.size();
+			const int nthreads = team.num_threads();
+			team.run([&](int tid){
+				IndexRange r = static_partition(n, tid, nthreads);
+				std::sort(pairs.begin()+r.first, pairs.begin()+r.last, less);
+			});
+			if (nthreads == 1) return;
+
+			std::vector<pair_type> buffer(n);
+			for (int width=1; width<nthreads; width*=2){
+				team.run([&](int tid){
+					// the merge of this thread's group, and this thread's piece of it
+					const int group = tid - tid % (2*width);
+					const int members = std::min(2*width, nthreads - group);
+					const std::size_t first = static_partition(n, group, nthreads).first;
+					const std::size_t last = static_partition(n, group+members-1, nthreads).last;
+					const std::size_t mid = (group+width < nthreads ? static_partition(n, group+width, nthreads).first : last);
+
+					const pair_type * a = pairs.data() + first;
+					const pair_type * b = pairs.data() + mid;
+					const std::size_t na = mid - first, nb = last - mid;
+					const std::size_t d0 = (na+nb)*(tid-group)/members, d1 = (na+nb)*(tid-group+1)/members;
+					const std::size_t i0 = merge_path(a, na, b, nb, d0, less), i1 = merge_path(a, na, b, nb, d1, less);
+					std::merge(a+i0, a+i1, b+(d0-i0), b+(d1-i1), buffer.begin()+first+d0, less);
+				});
+				pairs.swap(buffer);
+			}
+		}
+
+
+
+		template <std::size_t K, class IteratorType, class Compare>
+		std::vector<std::size_t> sort_permutation(IteratorType beg, IteratorType end, Compare comp){
+			typedef typename zip_key<K, IteratorType>::type 		key_type;
+
+			const std::size_t n = end - beg;
+			std::vector<std::pair<key_type, std::size_t>> pairs(n);
+			OmpTeam team;
+			const int nthreads = team.num_threads();
+			team.run([&](int tid){
+				IndexRange r = static_partition(n, tid, nthreads);
+				for (std::size_t i=r.first; i<r.last; i++) pairs[i] = std::make_pair(key_type(std::get<K>(*(beg+i))), i);
+			});
+			merge_sort_pairs(team, pairs, comp);
+
+			std::vector<std::size_t> perm(n);
+			for (std::size_t i=0; i<n; i++) perm[i] = pairs[i].second;
+			return perm;
+		}
+
+		template <std::size_t K, class IteratorType>
+		std::vector<std::size_t> sort_permutation(IteratorType beg, IteratorType end, std::true_type){
+			typedef typename zip_key<K, IteratorType>::type 		key_type;
+			typedef typename std::make_unsigned<key_type>::type 	radix_type;
+			const std::size_t n = end - beg;
+			std::vector<radix_type> 	keys(n);
+			std::vector<std::size_t> 	idx(n);
+
+			OmpTeam team;
+			const int nthreads = team.num_threads();
+			team.run([&](int tid){
+				IndexRange r = static_partition(n, tid, nthreads);
+				for (std::size_t i=r.first; i<r.last; i++){
+					keys[i] = radix_key(key_type(std::get<K>(*(beg+i))));
+					idx[i] = i;
+				}
+			});
+			radix_sort_pairs(team, keys, idx);
+			return idx;
+		}
+
+		template <std::size_t K, class IteratorType>
+		std::vector<std::size_t> sort_permutation(IteratorType beg, IteratorType end, std::false_type){
+			typedef typename zip_key<K, IteratorType>::type 		key_type;
+			return sort_permutation<K>(beg, end, std::less<key_type>());
+		}
+	} // end namespace Detail
+
+
+
+	// the permutation that sorts a random access zipped range by its K-th
+	// component, in ascending order. Element i of the sorted range is
+	// element perm[i] of the original range. The sort is stable
+	//
+	// e.g.:	auto perm = sort_permutation<0>(make_zip_iterator(morton.begin(), ids.begin()),
+	// 											make_zip_iterator(morton.end(), ids.end()));
+	template <std::size_t K,
+			  class IteratorType,
+			  class Compare>
+	std::vector<std::size_t> sort_permutation(IteratorType beg, IteratorType end, Compare comp){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_same<category, std::random_access_iterator_tag>::value, "Must be a random access iterator to sort!");
+		return Detail::sort_permutation<K>(beg, end, comp);
+	}
+
+	// integer keys are radix sorted, others use a parallel merge sort
+	template <std::size_t K,
+			  class IteratorType>
+	std::vector<std::size_t> sort_permutation(IteratorType beg, IteratorType end){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_same<category, std::random_access_iterator_tag>::value, "Must be a random access iterator to sort!");
+		typedef typename Detail::zip_key<K, IteratorType>::type 		key_type;
+		return Detail::sort_permutation<K>(beg, end, std::integral_constant<bool, Detail::is_radix_key<key_type>::value>());
+	}
+
+
+
+	// reorder a random access range so that element i becomes the
+	// original element perm[i]. With a zipped range, every array
+	// is gathered in the same single pass
+	template <class IteratorType>
+	void apply_permutation(IteratorType beg, IteratorType end, const std::vector<std::size_t> & perm){
+		typedef typename std::iterator_traits<IteratorType>::iterator_category category;
+		static_assert(std::is_same<category, std::random_access_iterator_tag>::value, "Must be a random access iterator to permute!");
+		typedef typename std::iterator_traits<IteratorType>::value_type 		value_type;
+
+		const std::size_t n = end - beg;
+		std::vector<value_type> tmp(n);
+		WorkStealingExecutor ex;
+		ex.run(n, [&](std::size_t first, std::size_t last){
+			for (std::size_t i=first; i<last; i++) tmp[i] = *(beg+perm[i]);
+		});
+		ex.run(n, [&](std::size_t first, std::size_t last){
+			for (std::size_t i=first; i<last; i++) *(beg+i) = std::move(tmp[i]);
+		});
+	}
+
+
+
+	// sort a zipped range of parallel arrays by its K-th component. The
+	// keys are sorted first (radix sort for integer keys), and then all
+	// arrays are moved in one pass. The sort is stable
+	//
+	// e.g.:	zip_sort<0>(make_zip_iterator(partition.begin(), x.begin(), y.begin(), ids.begin()),
+	// 					make_zip_iterator(partition.end(), x.end(), y.end(), ids.end()));
+	template <std::size_t K,
+			  class IteratorType>
+	void zip_sort(IteratorType beg, IteratorType end){
+		apply_permutation(beg, end, sort_permutation<K>(beg, end));
+	}
+
+	// sort with a comparison of keys
+	template <std::size_t K,
+			  class IteratorType,
+			  class Compare>
+	void zip_sort(IteratorType beg, IteratorType end, Compare comp){
+		apply_permutation(beg, end, sort_permutation<K>(beg, end, comp));
+	}
+
+
+} // end namespace simbox
+#endif
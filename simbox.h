@@ -7,12 +7,29 @@
 
 	#include "include/DataBufferWriter.hpp"
 	#include "include/GenericMesh.hpp"
+	#include "include/SoANodeContainer.hpp"
 	#include "include/ZipIterator.hpp"
 	#include "include/XDMFWriter.hpp"
 	#include "include/LookupTable.hpp"
+	#include "include/FlatMap.hpp"
+	#include "include/SetAlgebra.hpp"
+	#include "include/SetExpression.hpp"
+	#include "include/RoaringBitmap.hpp"
 	#include "include/MultiSetContainer.hpp"
 	// #include "include/SimulationData.hpp"
+	#include "include/WorkStealing.hpp"
+	#include "include/ExecutionPolicy.hpp"
+	#include "include/Schedule.hpp"
+	#include "include/Numa.hpp"
+	#include "include/ThreadPool.hpp"
 	#include "include/ForEach.hpp"
+	#include "include/Reduce.hpp"
+	#include "include/SimdPack.hpp"
+	#include "include/Coloring.hpp"
+	#include "include/TaskGraph.hpp"
+	#include "include/Async.hpp"
+	#include "include/ZipSort.hpp"
+	#include "include/Range.hpp"
 
 	
 	#ifdef H5T_IEEE_F32BE
@@ -0,0 +1,89 @@
+#include "../include/Async.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+struct AddTo{
+	void operator()(double & d, double a) const {d += a;};
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+bool all_equal(const std::vector<double> & v, double val){
+	for (auto i=0; i<v.size(); i++) if (v[i] != val) return false;
+	return true;
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::vector<double> a(10000, 0.0), b(10000, 0.0), c(10000, 0.0), d(10000, 0.0);
+
+	// a default handle is always ready
+	simbox::AsyncHandle none;
+	check("empty handle ready", none.ready());
+	none.wait();
+
+	// serial background loop
+	auto ha = simbox::for_each_async<Identity>(a.begin(), a.end(), AddTo(), 1.0);
+	ha.wait();
+	check("for_each_async", ha.ready() && all_equal(a, 1.0));
+
+	// background loops with policies, overlapping a pool loop on the caller
+	auto hb = simbox::for_each_async<Identity>(simbox::exec::pool, b.begin(), b.end(), AddTo(), 2.0);
+	auto hc = simbox::for_each_parallel_async<Identity>(c.begin(), c.end(), AddTo(), 3.0);
+	simbox::for_each<Identity>(simbox::exec::pool, d.begin(), d.end(), AddTo(), 4.0);
+	auto all = simbox::when_all(hb, hc);
+	all.get();
+	check("when_all", all.ready() && all_equal(b, 2.0) && all_equal(c, 3.0) && all_equal(d, 4.0));
+
+	// continuation runs after its handle
+	auto ht = simbox::for_each_async<Identity>(a.begin(), a.end(), AddTo(), 1.0)
+				.then([&](){for (auto i=0; i<a.size(); i++) a[i] *= 10.0;});
+	ht.get();
+	check("then", all_equal(a, 20.0));
+
+	// exceptions are rethrown by get()
+	auto he = simbox::launch_async([](){throw std::runtime_error("async failure");});
+	bool caught = false;
+	try {simbox::when_all(std::vector<simbox::AsyncHandle>{ha, he}).get();}
+	catch (const std::runtime_error & e) {caught = true;}
+	check("exception propagation", caught);
+
+	// continuations are skipped after a failure
+	bool ran = false;
+	auto hs = he.then([&](){ran = true;});
+	caught = false;
+	try {hs.get();}
+	catch (const std::runtime_error & e) {caught = true;}
+	check("then after exception", caught && !ran);
+
+	// helper threads are reused, and waiting continuations hold no thread
+	std::size_t nthreads = simbox::Detail::AsyncQueue::instance().num_threads();
+	for (auto i=0; i<50; i++) simbox::for_each_async<Identity>(a.begin(), a.end(), AddTo(), 1.0).wait();
+	std::atomic<bool> release(false);
+	auto gate = simbox::launch_async([&](){while (!release) std::this_thread::yield();});
+	simbox::AsyncHandle chain = gate;
+	for (auto i=0; i<50; i++) chain = chain.then([&](){for (auto j=0; j<a.size(); j++) a[j] += 1.0;});
+	bool waiting = !chain.ready();
+	release = true;
+	chain.get();
+	check("thread reuse", waiting && all_equal(a, 120.0) && simbox::Detail::AsyncQueue::instance().num_threads() <= nthreads + 1);
+
+	return 0;
+}
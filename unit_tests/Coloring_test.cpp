@@ -0,0 +1,82 @@
+#include "../include/Coloring.hpp"
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <set>
+#include <functional>
+#include <stdexcept>
+
+
+
+// quad element of a structured grid
+struct Quad{
+	std::array<unsigned int, 4> 	nodeinds;
+	double 							value;
+};
+
+struct QuadNodes{
+	static const std::array<unsigned int, 4> & get(const Quad & q) {return q.nodeinds;};
+};
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+// scatter a quarter of the element value into each node
+struct ScatterAdd{
+	void operator()(const Quad & q, std::vector<double> & nodal) const {
+		for (auto n=q.nodeinds.begin(); n!=q.nodeinds.end(); n++) nodal[*n] += 0.25*q.value;
+	}
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	// nx by ny quads
+	unsigned int nx = 200, ny = 150;
+	std::vector<Quad> quads;
+	for (unsigned int j=0; j<ny; j++){
+		for (unsigned int i=0; i<nx; i++){
+			unsigned int n0 = j*(nx+1) + i;
+			quads.push_back(Quad{{n0, n0+1, n0+nx+2, n0+nx+1}, double(i+j)});
+		}
+	}
+
+	simbox::ElementColoring coloring = simbox::ElementColoring::color<QuadNodes>(quads.begin(), quads.end());
+	coloring.print_summary();
+	check("four colors", coloring.num_colors() == 4);
+
+	// no two elements of a color share a node
+	bool pass = true;
+	for (std::size_t c=0; c<coloring.num_colors(); c++){
+		std::set<unsigned int> touched;
+		for (auto e=coloring.color_set(c).begin(); e!=coloring.color_set(c).end(); e++){
+			for (auto n=quads[*e].nodeinds.begin(); n!=quads[*e].nodeinds.end(); n++){
+				pass &= touched.insert(*n).second;
+			}
+		}
+	}
+	check("conflict free", pass);
+
+	// colored parallel scatter matches the serial one
+	std::vector<double> serial((nx+1)*(ny+1), 0.0), colored((nx+1)*(ny+1), 0.0);
+	for (auto it=quads.begin(); it!=quads.end(); it++) ScatterAdd()(*it, serial);
+	simbox::for_each_colored<Identity>(coloring, quads.begin(), quads.end(), ScatterAdd(), std::ref(colored));
+	check("colored scatter-add", serial == colored);
+
+	// a range the coloring was not computed for
+	bool thrown = false;
+	try {simbox::for_each_colored<Identity>(coloring, quads.begin(), quads.end()-1, ScatterAdd(), std::ref(colored));}
+	catch (const std::invalid_argument &) {thrown = true;}
+	check("size mismatch", thrown);
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "../include/FlatMap.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+template <typename FlatMap, typename Map>
+bool same(const FlatMap & f, const Map & m){
+	if (f.size() != m.size()) return false;
+	return std::equal(f.begin(), f.end(), m.begin(), [](const typename FlatMap::value_type & a, const typename Map::value_type & b){
+		return a.first == b.first && a.second == b.second;
+	});
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::mt19937 gen(3);
+
+	// single insertions behave as std::map
+	simbox::flat_map<int, double> f;
+	std::map<int, double> m;
+	bool pass = true;
+	for (auto i=0; i<2000; i++){
+		int k = gen() % 1000;
+		auto rf = f.insert(std::make_pair(k, double(i)));
+		auto rm = m.insert(std::make_pair(k, double(i)));
+		pass &= (rf.second == rm.second) && (rf.first->first == k) && (rf.first->second == rm.first->second);
+	}
+	check("insert", pass && same(f, m));
+
+	pass = true;
+	for (auto i=0; i<1000; i++){
+		f[i] += 1.0;
+		m[i] += 1.0;
+	}
+	f.emplace(5000, 1.0);
+	m.emplace(5000, 1.0);
+	check("operator[] and emplace", same(f, m));
+
+	pass = true;
+	for (auto k=-10; k<1100; k++) pass &= (f.count(k) == m.count(k));
+	pass &= (f.find(5000)->second == 1.0) && (f.find(4999) == f.end());
+	pass &= (f.lower_bound(500)->first == m.lower_bound(500)->first) && (f.upper_bound(500)->first == m.upper_bound(500)->first);
+	check("lookup", pass);
+
+	bool thrown = false;
+	try {f.at(-1);} catch (const std::out_of_range &) {thrown = true;}
+	check("at", thrown && f.at(5000) == 1.0);
+
+	pass = true;
+	for (auto k=0; k<1000; k+=3) pass &= (f.erase(k) == m.erase(k));
+	f.erase(f.begin(), f.begin()+10);
+	m.erase(m.begin(), std::next(m.begin(), 10));
+	check("erase", pass && same(f, m));
+
+	// a batch merges into the existing elements. Existing keys and
+	// repeated keys of the batch keep their first value
+	std::vector<std::pair<int, double>> batch;
+	for (auto i=0; i<5000; i++) batch.push_back(std::make_pair(int(gen() % 10000), -double(i)));
+	f.insert(batch.begin(), batch.end());
+	m.insert(batch.begin(), batch.end());
+	check("batched insert", same(f, m) && std::is_sorted(f.begin(), f.end()));
+
+	// a batch above every key is appended
+	std::vector<std::pair<int, double>> tail;
+	for (auto i=0; i<100; i++) tail.push_back(std::make_pair(20000 + 2*(99-i), double(i)));
+	f.insert(tail.begin(), tail.end());
+	m.insert(tail.begin(), tail.end());
+	check("batched append", same(f, m));
+
+	// construction, other orderings and iteration
+	simbox::flat_map<std::string, int, std::greater<std::string>> g{{"b", 2}, {"c", 3}, {"a", 1}, {"b", 5}};
+	std::string order;
+	for (auto & p : g) order += p.first;
+	check("initializer list and compare", order == "cba" && g.at("b") == 2);
+	check("random access", (g.end() - g.begin()) == 3 && (g.begin()+2)->first == "a");
+
+	return 0;
+}
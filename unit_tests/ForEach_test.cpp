@@ -0,0 +1,173 @@
+#include "../include/ForEach.hpp"
+#include "../include/MultiSetContainer.hpp"
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+// interface that pulls the mapped value out of a key-value pair
+struct MappedValue{
+	template <typename T>
+	static decltype(auto) get(T & t) {return (t.second);};
+};
+
+
+// functor with uneven per-element cost
+struct Increment{
+	void operator()(double & d, double by) const {
+		double w = 0;
+		int n = static_cast<int>(d) % 7 == 0 ? 2000 : 1;
+		for (auto i=0; i<n; i++) w += std::sin(i);
+		d += by + 0*w;
+	}
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	// random access
+	std::vector<double> v(100000);
+	for (auto i=0; i<v.size(); i++) v[i] = i;
+	simbox::for_each_parallel<Identity>(v.begin(), v.end(), Increment(), 1.0);
+	bool pass = true;
+	for (auto i=0; i<v.size(); i++) pass &= (v[i] == i+1);
+	check("vector", pass);
+
+	// bidirectional
+	std::list<double> l(v.begin(), v.end());
+	simbox::for_each_parallel<Identity>(l.begin(), l.end(), Increment(), 1.0);
+	pass = true;
+	int ct = 0;
+	for (auto it=l.begin(); it!=l.end(); it++, ct++) pass &= (*it == ct+2);
+	check("list", pass);
+
+	// std::map
+	std::map<int, double> m;
+	for (auto i=0; i<1000; i++) m[i] = i;
+	simbox::for_each_parallel<MappedValue>(m.begin(), m.end(), Increment(), 2.0);
+	pass = true;
+	for (auto it=m.begin(); it!=m.end(); it++) pass &= (it->second == it->first+2);
+	check("map", pass);
+
+	// a set of a set_map
+	simbox::set_map<int, double, std::string> sm;
+	for (auto i=0; i<1000; i++) sm[i] = i;
+	for (auto it=sm.begin(); it!=sm.end(); it++){
+		if (it->first % 3 == 0) sm.add_to_set(it, "threes");
+	}
+	simbox::for_each_parallel<MappedValue>(sm.set("threes").begin(), sm.set("threes").end(), Increment(), 1.0);
+	pass = true;
+	for (auto it=sm.begin(); it!=sm.end(); it++) pass &= (it->second == it->first + (it->first % 3 == 0 ? 1 : 0));
+	check("set_map set", pass);
+
+	// empty and tiny ranges
+	std::vector<double> e;
+	simbox::for_each_parallel<Identity>(e.begin(), e.end(), Increment(), 1.0);
+	std::vector<double> one(1, 0.0);
+	simbox::for_each_parallel<Identity>(one.begin(), one.end(), Increment(), 1.0);
+	check("small ranges", one[0] == 1.0);
+
+	// execution policies
+	std::vector<double> w(10000, 0.0);
+	simbox::for_each(simbox::exec::seq, w.begin(), w.end(), Increment(), 1.0);
+	simbox::for_each(simbox::exec::par, w.begin(), w.end(), Increment(), 1.0);
+	simbox::for_each(simbox::exec::simd, w.begin(), w.end(), Increment(), 1.0);
+	simbox::for_each(simbox::exec::par_simd, w.begin(), w.end(), Increment(), 1.0);
+	simbox::for_each<Identity>(simbox::exec::omp, w.begin(), w.end(), Increment(), 1.0);
+	simbox::exec::set_runtime_policy("seq");
+	simbox::for_each(simbox::exec::runtime, w.begin(), w.end(), Increment(), 1.0);
+	simbox::exec::set_runtime_policy(simbox::exec::policy_kind::PAR_SIMD);
+	simbox::for_each(simbox::exec::runtime, w.begin(), w.end(), Increment(), 1.0);
+	pass = true;
+	for (auto i=0; i<w.size(); i++) pass &= (w[i] == 7.0);
+	check("execution policies", pass);
+
+	simbox::for_each<MappedValue>(simbox::exec::par_simd, m.begin(), m.end(), Increment(), 1.0);
+	simbox::for_each<MappedValue>(simbox::exec::omp, m.begin(), m.end(), Increment(), 1.0);
+	simbox::for_each<MappedValue>(simbox::exec::simd, m.begin(), m.end(), Increment(), 1.0);
+	pass = true;
+	for (auto it=m.begin(); it!=m.end(); it++) pass &= (it->second == it->first+5);
+	check("execution policies on map", pass);
+
+	// schedules
+	omp_sched_t kind0, kind1;
+	int chunk0, chunk1;
+	omp_get_schedule(&kind0, &chunk0);
+	std::vector<simbox::Schedule> schedules = {simbox::Schedule(simbox::ScheduleKind::STATIC),
+											   simbox::Schedule(simbox::ScheduleKind::DYNAMIC, 64),
+											   simbox::Schedule(simbox::ScheduleKind::GUIDED),
+											   simbox::Schedule(simbox::ScheduleKind::STEAL, 16)};
+	for (auto s=schedules.begin(); s!=schedules.end(); s++){
+		simbox::for_each_parallel<Identity>(*s, w.begin(), w.end(), Increment(), 1.0);
+		simbox::for_each_parallel<Identity>(*s, l.begin(), l.end(), Increment(), 1.0);
+	}
+	pass = true;
+	for (auto i=0; i<w.size(); i++) pass &= (w[i] == 11.0);
+	ct = 0;
+	for (auto it=l.begin(); it!=l.end(); it++, ct++) pass &= (*it == ct+6);
+	omp_get_schedule(&kind1, &chunk1);
+	check("schedules", pass && kind0 == kind1 && chunk0 == chunk1);
+
+	// auto-tuned schedule
+	simbox::ScheduleTuner tuner;
+	for (auto i=0; i<20; i++){
+		simbox::for_each_parallel<Identity>(tuner, w.begin(), w.end(), Increment(), 1.0);
+		simbox::for_each_parallel<Identity>(simbox::autotune, w.begin(), w.end(), Increment(), 1.0);
+	}
+	tuner.print_summary();
+	pass = tuner.tuned();
+	for (auto i=0; i<w.size(); i++) pass &= (w[i] == 51.0);
+	check("auto-tuned schedule", pass);
+
+	// each thread tunes its own schedule
+	std::vector<std::vector<double>> wt(4, std::vector<double>(1000, 0.0));
+	#pragma omp parallel for num_threads(4)
+	for (auto t=0; t<4; t++){
+		for (auto i=0; i<20; i++) simbox::for_each_parallel<Identity>(simbox::autotune, wt[t].begin(), wt[t].end(), Increment(), 1.0);
+	}
+	pass = true;
+	for (auto t=0; t<4; t++) pass &= (std::count(wt[t].begin(), wt[t].end(), 20.0) == 1000);
+	check("auto-tuned from several threads", pass);
+
+	// fused kernels
+	std::vector<double> z(1000, 1.0);
+	std::vector<double> out(z.size(), 0.0);
+	double total = 0;
+	auto twice = [](double & d){d *= 2;};
+	auto clamp = [](double & d){d = std::min(d, 3.0);};
+	simbox::for_each_fused(z.begin(), z.end(), twice, twice, clamp, [&total](double & d){total += d;});
+	pass = (total == 3000.0);
+	simbox::for_each_fused<Identity>(z.begin(), z.end(), [](double & d){d -= 1.0;});
+	simbox::for_each_fused_parallel<Identity>(z.begin(), z.end(), twice, clamp, [&out, &z](double & d){out[&d - &z[0]] = d;});
+	simbox::for_each(simbox::exec::par_simd, z.begin(), z.end(), simbox::make_fused(twice, twice));
+	for (auto i=0; i<z.size(); i++) pass &= (out[i] == 3.0 && z[i] == 12.0);
+	check("fused", pass);
+
+	// arguments of the loop reach every fused functor
+	auto add = [](double & d, double a){d += a;};
+	auto scale = [](double & d, double a){d *= a;};
+	simbox::for_each(z.begin(), z.end(), simbox::make_fused(add, scale), 2.0);
+	simbox::for_each_parallel<Identity>(z.begin(), z.end(), simbox::make_fused(scale, add), 0.5);
+	simbox::for_each(simbox::exec::par, z.begin(), z.end(), simbox::make_fused(add), 1.0);
+	pass = true;
+	for (auto i=0; i<z.size(); i++) pass &= (z[i] == 15.5);
+	check("fused with arguments", pass);
+
+	return 0;
+}
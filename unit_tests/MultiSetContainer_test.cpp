@@ -1,7 +1,12 @@
 #include "../include/MultiSetContainer.hpp"
+#include "../include/ForEach.hpp"
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <iterator>
 
 
 
@@ -33,6 +38,23 @@ typedef std::vector<Object> base_vector_type;
 
 typedef simbox::set_map<int, Object, std::string> SetMap;
 typedef simbox::set_vector<Object, std::string> SetVector;
+typedef simbox::bitmap_set_vector<Object, std::string> BitmapSetVector;
+typedef simbox::sorted_set_map<int, Object, std::string> SortedSetMap;
+typedef simbox::sorted_set_vector<Object, std::string> SortedSetVector;
+typedef simbox::flat_set_map<int, Object, std::string> FlatSetMap;
+
+
+struct ObjectInterface{
+	static Object & get(std::pair<const int, Object> & p) {return p.second;};
+};
+
+struct Shift{
+	void operator()(Object & o, double d) const {o.x() += d;};
+};
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
 
 int main(int argc, char * argv[]){
 
@@ -82,6 +104,43 @@ int main(int argc, char * argv[]){
 		std::cout << "key: " << it->first << " x: " << it->second.x() << " y: " << it->second.y() << std::endl;
 	}
 
+	// sorted keys are cached by each set
+	m.add_to_set(m.find(3), "ends");
+	bool pass = (m.sorted_keys("ends") == std::vector<int>{1, 3, 8});
+	m.remove_from_set(m.find(8), "ends");
+	pass &= (m.sorted_keys("ends") == std::vector<int>{1, 3});
+	check("sorted keys", pass);
+	check("set intersection", m.set_intersection("odd", "ends") == std::vector<int>{1, 3} && m.set_intersection("even", "ends").empty());
+
+	// erased keys are removed from the cache, and a stale cache can be
+	// rebuilt by several readers at once
+	SetMap ck;
+	for (auto i=0; i<2000; i++) ck[i] = Object(i, 0);
+	ck.add_range_to_set(ck.begin(), ck.end(), "all");
+	std::vector<int> expected;
+	for (auto i=0; i<2000; i++) if (i % 7 != 0) expected.push_back(i);
+	for (auto i=0; i<2000; i+=14) ck.remove_from_set(ck.find(i), "all");
+	std::vector<int> sevens;
+	for (auto i=7; i<2000; i+=14) sevens.push_back(i);
+	ck.remove_range_from_set(sevens, "all");
+	pass = (ck.sorted_keys("all") == expected);
+	ck.add_to_set(ck.find(0), "all");
+	expected.insert(expected.begin(), 0);
+	const SetMap & cck = ck;
+	std::vector<int> same(8, 0);
+	#pragma omp parallel for num_threads(8)
+	for (auto t=0; t<8; t++) same[t] = (cck.sorted_keys("all") == expected);
+	check("sorted key cache", pass && std::count(same.begin(), same.end(), 1) == 8);
+
+	// single removals are compacted in one pass when the keys are next
+	// asked for, here by several readers at once
+	for (auto i=1; i<2000; i+=2) ck.remove_from_set(ck.find(i), "all");
+	expected.erase(std::remove_if(expected.begin(), expected.end(), [](int k){return k % 2 == 1;}), expected.end());
+	std::fill(same.begin(), same.end(), 0);
+	#pragma omp parallel for num_threads(8)
+	for (auto t=0; t<8; t++) same[t] = (cck.sorted_keys("all") == expected);
+	check("sorted key cache removals", std::count(same.begin(), same.end(), 1) == 8 && ck.set("all").size() == expected.size());
+
 
 	std::cout << "///////// SET VECTOR CONTAINER ////////" << std::endl;
 	// now for a vector container type
@@ -110,5 +169,262 @@ int main(int argc, char * argv[]){
 		std::cout << " x: " << it->x() << " y: " << it->y() << std::endl;
 	}
 
+	v.add_to_set(v.begin()+1, "ends");
+	v.add_to_set(v.begin()+3, "ends");
+	check("vector set intersection", v.set_intersection("odd", "ends") == std::vector<unsigned int>{1, 3});
+
+
+	std::cout << "///////// BITMAP SET VECTOR CONTAINER ////////" << std::endl;
+	// a vector container with bitmap sets
+	BitmapSetVector b;
+	for (auto i=0; i<100000; i++) b.push_back(Object(i, 2*i));
+
+	for(auto it=b.begin(); it!=b.end(); it++){
+		if ((it - b.begin()) % 2 == 0) 	b.add_to_set(it, "even");
+		if ((it - b.begin()) % 3 == 0) 	b.add_to_set(it, "three");
+	}
+	b.remove_from_set(b.begin()+6, "three");
+	check("bitmap sizes", b.set("even").size() == 50000 && b.set("three").size() == 33333);
+
+	pass = true;
+	auto bit = b.set("three").begin();
+	std::vector<unsigned int> first_threes = {0, 3, 9, 12};
+	for (auto i=0; i<4; i++, bit++) pass &= (bit.key() == first_threes[i]) && (bit->x() == first_threes[i]) && ((*bit).y() == 2*first_threes[i]);
+	check("bitmap iteration", pass);
+
+	std::vector<unsigned int> buffer;
+	pass = (b.set_intersection("even", "three").size() == 16666) && (b.set_difference("even", "three").size() == 33334);
+	pass &= (b.set_union("even", "three").size() == 66667) && (b.set_xor("even", "three").size() == 50001);
+	pass &= (b.set_intersection("even", "three", buffer) == 16666) && (b.set_xor("even", "three", buffer) == 50001);
+	check("bitmap set algebra", pass);
+
+	// buffers and queries of bitmap sets give the same keys as a merge
+	std::vector<unsigned int> evens, threes, merged;
+	for (auto it=b.set("even").begin(); it!=b.set("even").end(); it++) evens.push_back(it.key());
+	for (auto it=b.set("three").begin(); it!=b.set("three").end(); it++) threes.push_back(it.key());
+	std::set_symmetric_difference(evens.begin(), evens.end(), threes.begin(), threes.end(), std::back_inserter(merged));
+	pass = (b.set_xor("even", "three", buffer) == merged.size()) && (buffer == merged);
+	std::vector<unsigned int> raw(simbox::max_result_size(simbox::SetOperation::XOR, evens.size(), threes.size()));
+	pass &= (b.set_operation(simbox::SetOperation::XOR, "even", "three", raw.data()) == merged.size());
+	pass &= std::equal(merged.begin(), merged.end(), raw.begin());
+	std::vector<unsigned int> evaluated;
+	auto bq = b.query("even") ^ b.query("three");
+	pass &= (simbox::evaluate(bq, evaluated) == merged.size()) && (evaluated == merged) && (bq.to_vector() == merged);
+	pass &= ((b.query("even") - b.query("three")) & b.query("even")).size() == 33334;
+	check("bitmap buffers and queries", pass);
+	check("bitmap memory", b.set("even").memory_bytes() + b.set("three").memory_bytes() < 2*(50000 + 33333));
+
+	// elements are found from the current storage after the vector reallocates
+	b.push_back(Object(-1, -1));
+	b.shrink_to_fit();
+	pass = true;
+	for (auto it=b.set("three").begin(); it!=b.set("three").end(); it++) pass &= (it->x() == it.key());
+	check("bitmap after reallocation", pass);
+
+
+	std::cout << "///////// SORTED SET MAP CONTAINER ////////" << std::endl;
+	// a map container with sorted, random access sets
+	SortedSetMap sm;
+	for (auto i=0; i<1000; i++) sm[i] = Object(i, 0);
+	for (auto it=sm.begin(); it!=sm.end(); it++){
+		if (it->first % 10 == 0) sm.add_to_set(it, "tens");
+	}
+	sm.add_to_set(sm.find(5), "tens");
+	sm.remove_from_set(sm.find(990), "tens");
+
+	auto & tens = sm.set("tens");
+	simbox::for_each_parallel<ObjectInterface>(tens.begin(), tens.end(), Shift(), 0.5);
+	pass = (tens.size() == 100) && (tens.end() - tens.begin() == 100);
+	std::vector<int> first_tens = {0, 5, 10, 20};
+	for (auto i=0; i<4; i++){
+		auto it = tens.begin() + i;
+		pass &= (it.key() == first_tens[i]) && (it->first == first_tens[i]) && (it->second.x() == first_tens[i] + 0.5);
+	}
+	check("sorted set map", pass && (tens.end()-1).key() == 980);
+
+
+	std::cout << "///////// BULK SET OPERATIONS ////////" << std::endl;
+	// add, remove and assign many elements at once
+	SetVector bv;
+	for (auto i=0; i<1000; i++) bv.push_back(Object(i, 0));
+	bv.add_range_to_set(bv.begin()+100, bv.begin()+200, "block");
+	bv.add_range_to_set(std::vector<unsigned int>{50, 150, 999, 10, 10}, "block");
+	pass = (bv.set("block").size() == 103);
+	bv.remove_range_from_set(bv.begin()+100, bv.begin()+150, "block");
+	bv.remove_range_from_set(std::vector<unsigned int>{999, 7}, "block");
+	check("bulk add and remove", pass && bv.set("block").size() == 52);
+
+	SortedSetMap bsm;
+	for (auto i=0; i<100; i++) bsm[i] = Object(i, 0);
+	bsm.add_to_set(bsm.find(50), "s");
+	bsm.add_range_to_set(std::vector<int>{90, 10, 60, 50, 20}, "s");
+	pass = (bsm.sorted_keys("s") == std::vector<int>{10, 20, 50, 60, 90});
+	bsm.remove_range_from_set(std::vector<int>{20, 60}, "s");
+	pass &= (bsm.sorted_keys("s") == std::vector<int>{10, 50, 90});
+	check("bulk sorted keys", pass);
+
+	bsm.assign_set("s", std::vector<int>{3, 1, 2});
+	pass = (bsm.set("s").size() == 3);
+	for (auto it=bsm.set("s").begin(); it!=bsm.set("s").end(); it++) pass &= (it->second.x() == it.key()) && (it.key() == 1 + (it - bsm.set("s").begin()));
+	bsm.remove_range_from_set(std::vector<int>{1, 2, 3}, "s");
+	check("assign set", pass && bsm.enumerate_sets().empty());
+
+	BitmapSetVector bb;
+	for (auto i=0; i<100000; i++) bb.push_back(Object(i, 0));
+	bb.add_range_to_set(bb.begin(), bb.begin()+70000, "low");
+	bb.assign_set("high", bb.begin()+50000, bb.end());
+	check("bulk bitmap sets", bb.set_intersection("low", "high").size() == 20000);
+
+
+	std::cout << "///////// SET MEMBERSHIP ////////" << std::endl;
+	// many sets per element, including ids past the first mask word
+	SetMap ms;
+	for (auto i=0; i<10; i++) ms[i] = Object(i, 0);
+	for (auto k=0; k<100; k++){
+		for (auto it=ms.begin(); it!=ms.end(); it++) ms.add_to_set(it, "s" + std::to_string(k));
+	}
+	ms.add_to_set(ms.find(3), "s70");
+	pass = (ms.num_sets_of(ms.find(3)) == 100) && (ms.set("s70").size() == 10);
+	ms.remove_from_set(ms.find(3), "s70");
+	ms.remove_from_set(ms.find(3), "s5");
+	ms.remove_from_set(ms.find(3), "s5");
+	ms.remove_from_set(ms.find(3), "nope");
+	pass &= !ms.in_set(ms.find(3), "s70") && ms.in_set(ms.find(3), "s71") && ms.in_set(4, "s70");
+	check("membership", pass && ms.num_sets_of(ms.find(3)) == 98);
+
+	for (auto it=ms.begin(); it!=ms.end(); it++) ms.remove_from_set(it, "s0");
+	ms.add_to_set(ms.find(1), "reused");
+	std::vector<std::string> some;
+	for (auto st : ms.sets_of(ms.find(1))) if (st == "reused" || st == "s0" || st == "s1") some.push_back(st);
+	std::sort(some.begin(), some.end());
+	check("set id reuse", some == std::vector<std::string>{"reused", "s1"} && ms.enumerate_sets().size() == 100);
+
+	// the same with the dense index of a vector container, where ids past
+	// the first word are kept aside, and follow their keys when reordered
+	SetVector mv;
+	for (auto i=0; i<10; i++) mv.push_back(Object(i, 0));
+	for (auto k=0; k<100; k++){
+		for (auto it=mv.begin(); it!=mv.end(); it++) if ((it - mv.begin()) % 2 == k % 2) mv.add_to_set(it, "s" + std::to_string(k));
+	}
+	mv.add_to_set(mv.begin()+9, "last");
+	mv.remove_from_set(mv.begin()+1, "s71");
+	pass = (mv.num_sets_of(mv.begin()+1) == 49) && (mv.num_sets_of(mv.begin()+2) == 50) && mv.in_set(3, "s99") && !mv.in_set(1, "s71");
+	auto perm = mv.make_set_contiguous("last");
+	pass &= (perm[0] == 9) && (mv.begin()->x() == 9) && (mv.num_sets_of(mv.begin()) == 51) && mv.in_set(0, "s99") && !mv.in_set(2, "s71") && mv.in_set(2, "s73") && mv.in_set(3, "s70");
+	std::vector<std::string> sets9 = mv.sets_of(mv.begin());
+	check("dense membership", pass && sets9.size() == 51 && std::count(sets9.begin(), sets9.end(), "s97") == 1);
+
+
+	std::cout << "///////// SET CONTIGUOUS REORDERING ////////" << std::endl;
+	// move the members of a set to the front of the vector
+	for (auto policy=0; policy<3; policy++){
+		SetVector hv;
+		SortedSetVector sv;
+		BitmapSetVector bv2;
+		for (auto i=0; i<20; i++){
+			hv.push_back(Object(i, 0));
+			sv.push_back(Object(i, 0));
+			bv2.push_back(Object(i, 0));
+		}
+		std::vector<std::size_t> perm;
+		std::vector<double> xs, odds;
+		pass = true;
+		auto run = [&](auto & c){
+			for (auto it=c.begin(); it!=c.end(); it++){
+				if ((it - c.begin()) % 5 == 0) c.add_to_set(it, "wall");
+				if ((it - c.begin()) % 2 == 1) c.add_to_set(it, "odd");
+			}
+			perm = c.make_sets_contiguous({"wall", "odd"});
+			for (auto & o : c.contiguous_range("wall")) xs.push_back(o.x());
+			pass &= c.is_contiguous("wall") && !c.is_contiguous("odd");
+			for (auto it=c.set("odd").begin(); it!=c.set("odd").end(); it++) odds.push_back(it->x());
+			pass &= c.in_set(c.begin()+3, "wall") && c.in_set(c.begin()+3, "odd");
+		};
+		if (policy == 0) run(hv);
+		if (policy == 1) run(sv);
+		if (policy == 2) run(bv2);
+		std::sort(odds.begin(), odds.end());
+		pass &= (xs == std::vector<double>{0, 5, 10, 15}) && (odds == std::vector<double>{1, 3, 5, 7, 9, 11, 13, 15, 17, 19});
+		pass &= (std::vector<std::size_t>(perm.begin(), perm.begin()+8) == std::vector<std::size_t>{0, 5, 10, 15, 1, 3, 7, 9});
+		check("contiguous sets (policy " + std::to_string(policy) + ")", pass);
+	}
+
+
+	std::cout << "///////// CONCURRENT INSERTION ////////" << std::endl;
+	// tag elements into sets from many threads
+	SetVector cv;
+	const int ncv = 200000;
+	for (auto i=0; i<ncv; i++) cv.push_back(Object(i, 0));
+	cv.add_to_set(cv.begin()+3, "three");
+	{
+		SetVector::concurrent_inserter ins(cv);
+		#pragma omp parallel for
+		for (int i=0; i<ncv; i++){
+			if (i % 3 == 0) ins.add_to_set(i, "three");
+			if (i % 7 == 0) ins.add_to_set(cv.begin()+i, "seven");
+		}
+		ins.commit();
+		check("concurrent insertion", cv.set("three").size() == 66667 && cv.set("seven").size() == 28572);
+
+		// the same inserter again, from std::threads
+		std::vector<std::thread> threads;
+		for (auto t=0; t<4; t++){
+			threads.emplace_back([&ins, &cv, t, ncv](){
+				for (int i=t; i<ncv; i+=4) if (i % 5 == 0) ins.add_to_set(cv.begin()+i, "five");
+			});
+		}
+		for (auto & t : threads) t.join();
+	}
+	pass = (cv.set("five").size() == 40000) && std::is_sorted(cv.sorted_keys("seven").begin(), cv.sorted_keys("seven").end());
+	pass &= cv.in_set(21, "three") && cv.in_set(21, "seven") && (cv.set("five").at(35)->x() == 35);
+	check("concurrent insertion from threads", pass);
+
+
+	std::cout << "///////// FLAT SET MAP CONTAINER ////////" << std::endl;
+	// a flat map container with a flat set registry
+	FlatSetMap fm;
+	std::vector<std::pair<int, Object>> objs;
+	for (auto i=999; i>=0; i--) objs.push_back(std::make_pair(i, Object(i, 1)));
+	fm.insert(objs.begin(), objs.end());
+	check("flat map", fm.size() == 1000 && fm.begin()->first == 0 && (fm.end() - fm.begin()) == 1000);
+	for (auto it=fm.begin(); it!=fm.end(); it++){
+		if (it->first % 4 == 0) fm.add_to_set(it, "four");
+		if (it->first % 6 == 0) fm.add_to_set(it, "six");
+	}
+	fm.add_range_to_set(std::vector<int>{1, 2, 3}, "small");
+	auto fq = (fm.query("four") & fm.query("six")) | fm.query("small");
+	std::vector<int> firsts;
+	for (auto k : fq) if (k < 30) firsts.push_back(k);
+	check("flat set query", fq.size() == 87 && firsts == std::vector<int>{0, 1, 2, 3, 12, 24});
+	check("flat set registry", fm.enumerate_sets() == std::vector<std::string>{"four", "six", "small"} && fm.set_union("four", "none").size() == 250);
+	fm.remove_range_from_set(std::vector<int>{1, 2, 3}, "small");
+	check("flat set removal", fm.set("six").begin()[2].second.x() == 12 && fm.enumerate_sets().size() == 2);
+
+	// inserting moves the elements (past the capacity, or within it), and
+	// the sets follow them without being told
+	std::vector<std::pair<int, Object>> more;
+	for (auto i=-100; i<0; i++) more.push_back(std::make_pair(i, Object(i, 2)));
+	for (auto i=1000; i<1100 || fm.size() + more.size() <= fm.capacity(); i++) more.push_back(std::make_pair(i, Object(i, 2)));
+	const std::size_t nfm = fm.size() + more.size();
+	fm.insert(more.begin(), more.end());
+	pass = (fm.size() == nfm) && (fm.set("four").size() == 250) && (fm.set("six").size() == 167);
+	for (auto it=fm.set("six").begin(); it!=fm.set("six").end(); it++) pass &= (it->first == it.key()) && (it->second.x() == it.key()) && (it->second.y() == 1);
+	fm.reserve(fm.size() + 10);
+	fm.emplace(-500, Object(-500, 2));
+	for (auto it=fm.set("four").begin(); it!=fm.set("four").end(); it++) pass &= (it->first == it.key()) && (it->second.x() == it.key());
+	for (auto it=fm.begin(); it!=fm.end(); it++) if (it->first % 4 == 0 && it->first < 0) fm.add_to_set(it, "four");
+	pass &= (fm.set("four").size() == 276) && (fm.set("four").begin()->first == -500) && (fm.set("four").begin()->second.y() == 2);
+	for (auto it=fm.set("four").begin(); it!=fm.set("four").end(); it++) pass &= (it->first == it.key()) && (it->second.x() == it.key());
+
+	// the same for a vector that reallocates
+	SetVector sv;
+	for (auto i=0; i<10; i++) sv.push_back(Object(i, 0));
+	sv.add_range_to_set(sv.begin(), sv.end(), "all");
+	const std::size_t cap = sv.capacity();
+	while (sv.size() <= cap) sv.push_back(Object(int(sv.size()), 0));
+	for (auto it=sv.set("all").begin(); it!=sv.set("all").end(); it++) pass &= (it->x() == int(it.key()));
+	pass &= (sv.set("all").size() == 10);
+	check("flat set map after insertion", pass);
+
 	return 0;
-}
\ No newline at end of file
+}
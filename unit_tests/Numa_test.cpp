@@ -0,0 +1,59 @@
+#include "../include/Numa.hpp"
+#include "../include/ForEach.hpp"
+
+#include <iostream>
+#include <vector>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+struct Scale{
+	void operator()(double & d, double a) const {d *= a;};
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	simbox::set_thread_affinity(simbox::Affinity::SCATTER);
+	for (int t=0; t<4; t++){
+		std::cout << "thread " << t << " of 4 -> compact cpu " << simbox::affinity_cpu(simbox::Affinity::COMPACT, t, 4)
+				  << ", scatter cpu " << simbox::affinity_cpu(simbox::Affinity::SCATTER, t, 4) << std::endl;
+	}
+
+	// first-touch a field, then work on it with the same partition
+	simbox::first_touch_vector<double> f;
+	simbox::first_touch_resize(f, 1000000, 2.0);
+	simbox::for_each_parallel<Identity>(f.begin(), f.end(), Scale(), 0.5);
+	bool pass = (f.size() == 1000000);
+	for (auto it=f.begin(); it!=f.end(); it++) pass &= (*it == 1.0);
+	simbox::OmpTeam team;
+	simbox::first_touch_resize(team, f, 1500000, 3.0);
+	pass = (f.size() == 1500000) && (f[999999] == 1.0) && (f[1000000] == 3.0) && (f.back() == 3.0);
+	check("first_touch_resize", pass);
+
+	// generated values, e.g. node coordinates
+	simbox::first_touch_vector<double> x;
+	x.resize(1001);
+	simbox::first_touch(x.begin(), x.end(), [](std::size_t i){return 0.001*i;});
+	check("first_touch", x[0] == 0.0 && x[500] == 0.5 && x[1000] == 1.0);
+
+	// on a pinned pool
+	simbox::ThreadPool pool(0, simbox::Affinity::COMPACT);
+	std::vector<int> ids(1000, -1);
+	simbox::first_touch(pool, ids.begin(), ids.end(), [](std::size_t i){return int(i);});
+	pass = true;
+	for (auto i=0; i<ids.size(); i++) pass &= (ids[i] == i);
+	check("first_touch on pool", pass);
+
+	return 0;
+}
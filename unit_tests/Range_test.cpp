@@ -0,0 +1,110 @@
+#include "../include/Range.hpp"
+#include "../include/ZipIterator.hpp"
+#include "../include/MultiSetContainer.hpp"
+#include "../include/ForEach.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <list>
+#include <atomic>
+#include <stdexcept>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+// interface for views that dereference to temporaries
+struct ByValue{
+	template <typename T>
+	static T get(T t) {return t;};
+};
+
+struct Scale{
+	template <typename Ref>
+	void operator()(Ref r, double a) const {std::get<1>(r) = a*std::get<0>(r);};
+};
+
+struct SumChunk{
+	template <typename Chunk>
+	void operator()(Chunk c, std::atomic<long> & tot) const {
+		long s = 0;
+		for (auto it=c.begin(); it!=c.end(); it++) s += *it;
+		tot += s;
+	};
+};
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	namespace view = simbox::view;
+
+	std::vector<int> v(100);
+	for (auto i=0; i<100; i++) v[i] = i;
+
+	// filter, then transform
+	auto ev = view::transform(view::filter(v, [](int i){return i % 2 == 0;}), [](int i){return i*i;});
+	long sum = 0;
+	for (auto it=ev.begin(); it!=ev.end(); it++) sum += *it;
+	check("filter/transform", sum == 161700 && ev.size() == 50);
+
+	// stride over random access and forward ranges
+	std::list<int> l(v.begin(), v.end());
+	auto sv = view::stride(v, 7);
+	auto sl = view::stride(l, 7);
+	bool pass = (sv.size() == 15 && sl.size() == 15 && sv.begin()[14] == 98);
+	auto lit = sl.begin();
+	for (auto it=sv.begin(); it!=sv.end(); it++, lit++) pass = pass && *it == *lit;
+	check("stride", pass);
+
+	// enumerate
+	pass = true;
+	for (auto p : view::enumerate(view::stride(v, 10))) pass = pass && int(p.first)*10 == p.second;
+	check("enumerate", pass);
+
+	// chunks in parallel
+	std::atomic<long> tot(0);
+	auto ch = view::chunk(v, 16);
+	simbox::for_each_parallel<ByValue>(ch.begin(), ch.end(), SumChunk(), std::ref(tot));
+	check("chunk", ch.size() == 7 && (*(ch.end()-1)).size() == 4 && tot == 4950);
+
+	// a strided zipped range in parallel
+	std::vector<double> x(1000, 2.0), y(1000, 0.0);
+	auto z = simbox::make_range(simbox::make_zip_iterator(x.begin(), y.begin()),
+								simbox::make_zip_iterator(x.end(), y.end()));
+	auto zs = view::stride(z, 2);
+	simbox::for_each_parallel<ByValue>(zs.begin(), zs.end(), Scale(), 3.0);
+	pass = true;
+	for (auto i=0; i<1000; i++) pass = pass && y[i] == (i % 2 == 0 ? 6.0 : 0.0);
+	check("strided zip", pass);
+
+	// zero strides and chunk sizes are rejected
+	int thrown = 0;
+	try {view::stride(v, 0);} catch (const std::invalid_argument &) {thrown++;}
+	try {view::chunk(l, 0);} catch (const std::invalid_argument &) {thrown++;}
+	check("zero stride and chunk", thrown == 2);
+
+	// filter the elements of a set
+	simbox::set_map<int, double, std::string> m;
+	for (auto i=0; i<20; i++) m[i] = 0.5*i;
+	for (auto it=m.begin(); it!=m.end(); it++) if (it->first % 3 == 0) m.add_to_set(it, "boundary");
+	auto hot = view::filter(m.set("boundary"), [](const std::pair<const int, double> & p){return p.second > 4.0;});
+	simbox::for_each<Identity>(hot.begin(), hot.end(), [](std::pair<const int, double> & p){p.second = -1.0;});
+	pass = true;
+	for (auto it=m.begin(); it!=m.end(); it++){
+		bool flagged = (it->first % 3 == 0 && 0.5*it->first > 4.0);
+		pass = pass && (flagged == (it->second == -1.0));
+	}
+	check("filtered set", pass);
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "../include/Reduce.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <list>
+#include <map>
+#include <cmath>
+#include <functional>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+// interface that pulls the mapped value out of a key-value pair
+struct MappedValue{
+	template <typename T>
+	static decltype(auto) get(T & t) {return (t.second);};
+};
+
+
+// extents of a set of 2D points
+struct Extents{
+	double xmin, xmax, ymin, ymax;
+};
+
+struct PointExtents{
+	Extents operator()(const std::pair<double, double> & p) const {return Extents{p.first, p.first, p.second, p.second};};
+};
+
+struct CombineExtents{
+	Extents operator()(const Extents & a, const Extents & b) const {
+		return Extents{std::min(a.xmin, b.xmin), std::max(a.xmax, b.xmax),
+					   std::min(a.ymin, b.ymin), std::max(a.ymax, b.ymax)};
+	};
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	// integer sum is exact
+	std::vector<long> v(100000);
+	for (auto i=0; i<v.size(); i++) v[i] = i;
+	long s = simbox::reduce_parallel<Identity>(v.begin(), v.end(), 0l, std::plus<long>());
+	check("integer sum", s == long(v.size())*(v.size()-1)/2);
+
+	std::list<long> l(v.begin(), v.end());
+	long sl = simbox::reduce_parallel<Identity>(l.begin(), l.end(), 5l, std::plus<long>());
+	check("list sum", sl == s+5);
+
+	// sum of squares over a map
+	std::map<int, double> m;
+	for (auto i=0; i<1000; i++) m[i] = i;
+	double ss = simbox::transform_reduce_parallel<MappedValue>(m.begin(), m.end(), 0.0, std::plus<double>(), [](double d){return d*d;});
+	check("map sum of squares", ss == 332833500.0);
+
+	// extents
+	std::vector<std::pair<double, double>> pts;
+	for (auto i=0; i<5000; i++) pts.push_back(std::make_pair(std::sin(0.1*i), 2*std::cos(0.3*i)));
+	Extents e0{pts[0].first, pts[0].first, pts[0].second, pts[0].second};
+	Extents e = simbox::transform_reduce_parallel<Identity>(pts.begin(), pts.end(), e0, CombineExtents(), PointExtents());
+	std::cout << "extents: [" << e.xmin << ", " << e.xmax << "] x [" << e.ymin << ", " << e.ymax << "]" << std::endl;
+	check("extents", e.xmin < -0.99 && e.xmax > 0.99 && e.ymin < -1.99 && e.ymax > 1.99);
+
+	// non-commutative combine is still done in range order
+	std::vector<std::string> words = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j"};
+	std::string cat = simbox::reduce_parallel<Identity>(words.begin(), words.end(), std::string(""), std::plus<std::string>());
+	check("ordered combine", cat == "abcdefghij");
+
+	// deterministic floating point sums agree bitwise for every thread count
+	std::vector<double> f(1000003);
+	for (auto i=0; i<f.size(); i++) f[i] = 1.0/(i+1) * (i % 2 == 0 ? 1 : -1e-3);
+	std::vector<double> sums;
+	for (int nt=1; nt<=8; nt*=2){
+		omp_set_num_threads(nt);
+		sums.push_back(simbox::reduce_parallel<Identity>(simbox::deterministic, f.begin(), f.end(), 0.0, std::plus<double>()));
+	}
+	std::cout << std::setprecision(17) << "deterministic sum: " << sums[0] << std::endl;
+	bool pass = true;
+	for (auto it=sums.begin(); it!=sums.end(); it++) pass &= (*it == sums[0]);
+	check("deterministic sum", pass);
+
+	return 0;
+}
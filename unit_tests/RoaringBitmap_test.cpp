@@ -0,0 +1,77 @@
+#include "../include/RoaringBitmap.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <set>
+#include <random>
+#include <algorithm>
+#include <iterator>
+
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+std::vector<std::uint32_t> to_vector(const std::set<std::uint32_t> & s){
+	return std::vector<std::uint32_t>(s.begin(), s.end());
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::mt19937 gen(3);
+
+	// a mix of sparse chunks (arrays) and dense chunks (bitmaps)
+	simbox::RoaringBitmap a, b;
+	std::set<std::uint32_t> sa, sb;
+	for (auto i=0; i<20000; i++){
+		std::uint32_t x = gen() % 200000;
+		std::uint32_t y = 65536*(gen() % 40) + gen() % 3000;
+		a.add(x); sa.insert(x);
+		a.add(y); sa.insert(y);
+		b.add(gen() % 150000); 
+	}
+	for (auto it=b.begin(); it!=b.end(); it++) sb.insert(*it);
+
+	check("cardinality", a.cardinality() == sa.size() && b.cardinality() == sb.size());
+	check("ascending iteration", a.to_vector() == to_vector(sa));
+
+	bool pass = true;
+	for (std::uint32_t x=0; x<300000; x+=7) pass = pass && (a.contains(x) == (sa.count(x) > 0));
+	check("contains", pass);
+
+	// removal converts dense chunks back to arrays
+	for (std::uint32_t x=0; x<200000; x+=2){
+		pass = pass && (a.remove(x) == (sa.erase(x) > 0));
+	}
+	check("remove", pass && a.to_vector() == to_vector(sa));
+
+	// set algebra
+	std::vector<std::uint32_t> ref;
+	std::set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(), std::back_inserter(ref));
+	check("and", (a & b).to_vector() == ref);
+	ref.clear();
+	std::set_union(sa.begin(), sa.end(), sb.begin(), sb.end(), std::back_inserter(ref));
+	check("or", (a | b).to_vector() == ref);
+	ref.clear();
+	std::set_difference(sa.begin(), sa.end(), sb.begin(), sb.end(), std::back_inserter(ref));
+	check("andnot", (a - b).to_vector() == ref);
+	ref.clear();
+	std::set_symmetric_difference(sa.begin(), sa.end(), sb.begin(), sb.end(), std::back_inserter(ref));
+	check("xor", (a ^ b).to_vector() == ref);
+	check("equality", (a | b) == (b | a) && (a ^ a).empty());
+
+	// find
+	auto f = a.find(*sa.rbegin());
+	check("find", f != a.end() && *f == *sa.rbegin() && ++f == a.end() && a.find(0) == a.end());
+
+	// a dense million-element set stays near one bit per element
+	simbox::RoaringBitmap d;
+	for (std::uint32_t x=0; x<1000000; x++) if (x % 5 != 0) d.add(x);
+	std::cout << "dense bytes per element: " << double(d.memory_bytes())/d.cardinality() << std::endl;
+	check("dense memory", d.memory_bytes() < d.cardinality()/4);
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include "../include/SetAlgebra.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <iterator>
+
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+std::vector<unsigned int> random_keys(std::mt19937 & gen, std::size_t n, unsigned int range){
+	std::vector<unsigned int> k(n);
+	for (auto & x : k) x = gen() % range;
+	std::sort(k.begin(), k.end());
+	k.erase(std::unique(k.begin(), k.end()), k.end());
+	return k;
+}
+
+std::vector<unsigned int> reference(simbox::SetOperation op, const std::vector<unsigned int> & a, const std::vector<unsigned int> & b){
+	std::vector<unsigned int> out;
+	auto o = std::back_inserter(out);
+	switch (op){
+		case simbox::SetOperation::INTERSECTION: 	std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), o); break;
+		case simbox::SetOperation::DIFFERENCE: 		std::set_difference(a.begin(), a.end(), b.begin(), b.end(), o); break;
+		case simbox::SetOperation::UNION: 			std::set_union(a.begin(), a.end(), b.begin(), b.end(), o); break;
+		case simbox::SetOperation::XOR: 			std::set_symmetric_difference(a.begin(), a.end(), b.begin(), b.end(), o); break;
+	}
+	return out;
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::mt19937 gen(11);
+	const simbox::SetOperation ops[] = {simbox::SetOperation::INTERSECTION, simbox::SetOperation::DIFFERENCE,
+										simbox::SetOperation::UNION, simbox::SetOperation::XOR};
+	const std::string names[] = {"intersection", "difference", "union", "xor"};
+
+	// overlapping, dense, disjoint, identical and empty inputs
+	std::vector<std::pair<std::vector<unsigned int>, std::vector<unsigned int>>> cases;
+	cases.push_back(std::make_pair(random_keys(gen, 200000, 1000000), random_keys(gen, 150000, 1000000)));
+	cases.push_back(std::make_pair(random_keys(gen, 200000, 250000), random_keys(gen, 200000, 250000)));
+	cases.push_back(std::make_pair(random_keys(gen, 5000, 100000), random_keys(gen, 300000, 100000000)));
+	std::vector<unsigned int> lo(100000), hi(100000);
+	for (unsigned int i=0; i<100000; i++) {lo[i] = i; hi[i] = 100000 + i;}
+	cases.push_back(std::make_pair(lo, hi));
+	cases.push_back(std::make_pair(hi, lo));
+	cases.push_back(std::make_pair(lo, lo));
+	cases.push_back(std::make_pair(lo, std::vector<unsigned int>()));
+
+	for (auto o=0; o<4; o++){
+		bool pass = true;
+		for (auto c=cases.begin(); c!=cases.end(); c++){
+			const std::vector<unsigned int> & a = c->first;
+			const std::vector<unsigned int> & b = c->second;
+			std::vector<unsigned int> ref = reference(ops[o], a, b);
+
+			// small grain so that every case is split between threads
+			std::vector<unsigned int> out(simbox::max_result_size(ops[o], a.size(), b.size()));
+			std::size_t n = simbox::parallel_set_operation(ops[o], a.data(), a.size(), b.data(), b.size(), out.data(), 64);
+			out.resize(n);
+			pass = pass && (out == ref);
+
+			std::vector<unsigned int> vout;
+			simbox::parallel_set_operation(ops[o], a, b, vout);
+			pass = pass && (vout == ref);
+		}
+		check(names[o], pass);
+	}
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include "../include/SetExpression.hpp"
+#include "../include/MultiSetContainer.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <iterator>
+
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+std::vector<unsigned int> random_keys(std::mt19937 & gen, std::size_t n, unsigned int range){
+	std::vector<unsigned int> k(n);
+	for (auto & x : k) x = gen() % range;
+	std::sort(k.begin(), k.end());
+	k.erase(std::unique(k.begin(), k.end()), k.end());
+	return k;
+}
+
+typedef std::vector<unsigned int> keys;
+
+keys set_union(const keys & a, const keys & b){
+	keys out;
+	std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+	return out;
+}
+
+keys set_intersection(const keys & a, const keys & b){
+	keys out;
+	std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+	return out;
+}
+
+keys set_difference(const keys & a, const keys & b){
+	keys out;
+	std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+	return out;
+}
+
+keys set_xor(const keys & a, const keys & b){
+	keys out;
+	std::set_symmetric_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+	return out;
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::mt19937 gen(5);
+	keys a = random_keys(gen, 5000, 20000);
+	keys b = random_keys(gen, 3000, 20000);
+	keys c = random_keys(gen, 8000, 20000);
+	keys e;
+	simbox::SetTerminal<unsigned int> A(a), B(b), C(c), E(e);
+
+	// single operations
+	check("union", (A | B).to_vector() == set_union(a, b));
+	check("intersection", (A & B).to_vector() == set_intersection(a, b));
+	check("difference", (A - B).to_vector() == set_difference(a, b));
+	check("xor", (A ^ B).to_vector() == set_xor(a, b));
+	check("empty side", (A & E).to_vector().empty() && (E - A).to_vector().empty() && (A | E).to_vector() == a && (E ^ A).to_vector() == a);
+
+	// nested expressions are one fused merge
+	check("(a | b) - c", ((A | B) - C).to_vector() == set_difference(set_union(a, b), c));
+	check("a & (b ^ c)", (A & (B ^ C)).to_vector() == set_intersection(a, set_xor(b, c)));
+	check("(a - b) | (c & a)", ((A - B) | (C & A)).to_vector() == set_union(set_difference(a, b), set_intersection(c, a)));
+
+	// free evaluate, including the parallel path for a single operation
+	keys out;
+	bool pass = true;
+	simbox::evaluate(A ^ C, out); 			pass &= (out == set_xor(a, c));
+	simbox::evaluate((A ^ C) & B, out); 	pass &= (out == set_intersection(set_xor(a, c), b));
+	check("evaluate into buffer", pass);
+
+	// lazy iteration
+	keys lazy;
+	auto q = (A | B) - C;
+	for (auto k : q) lazy.push_back(k);
+	check("lazy iteration", lazy == set_difference(set_union(a, b), c) && q.size() == lazy.size());
+	check("lazy stops early", *std::find_if(q.begin(), q.end(), [](unsigned int k){return k > 10000;}) > 10000);
+
+	// queries of a MultiSetContainer
+	simbox::set_vector<double, std::string> m;
+	for (auto i=0; i<1000; i++) m.push_back(i);
+	for (auto it=m.begin(); it!=m.end(); it++){
+		unsigned int k = it - m.begin();
+		if (k < 100) 			m.add_to_set(it, "inlet");
+		if (k % 10 == 0) 		m.add_to_set(it, "wall");
+		if (k % 50 == 0) 		m.add_to_set(it, "corner");
+	}
+	keys expect;
+	for (unsigned int k=0; k<1000; k++) if ((k < 100 || k % 10 == 0) && k % 50 != 0) expect.push_back(k);
+	check("set container query", ((m.query("inlet") | m.query("wall")) - m.query("corner")).to_vector() == expect);
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include "../include/SimdPack.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+
+
+// relaxation update that works on both packs and scalars
+struct Relax{
+	template <typename V>
+	void operator()(V & u, double dt, double target) const {
+		u += dt*(target - u);
+	}
+};
+
+// clamp to [0, hi] with an unqualified call so packs use simbox::min
+struct Clamp{
+	template <typename V>
+	void operator()(V & u, double hi) const {
+		using std::min;
+		using std::max;
+		u = min(max(u, V(0.0)), V(hi));
+	}
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	typedef simbox::SimdPack<double, 4> pack;
+	pack a(1.0), b = pack::load(std::vector<double>({1, 2, 3, 4}).data());
+	pack c = 2.0*a + b/2.0 - sqrt(b*b);
+	check("pack arithmetic", c[0] == 1.5 && c[1] == 1.0 && c[2] == 0.5 && c[3] == 0.0);
+
+	// 1003 elements: 250 packs of 4 and a scalar remainder of 3
+	std::vector<double> u(1003, 0.0);
+	simbox::for_each_simd<4>(u.begin(), u.end(), Relax(), 0.5, 2.0);
+	bool pass = true;
+	for (auto it=u.begin(); it!=u.end(); it++) pass &= (*it == 1.0);
+	check("for_each_simd", pass);
+
+	for (auto i=0; i<u.size(); i++) u[i] = -5.0 + 0.01*i;
+	simbox::for_each_simd_parallel<8>(u.begin(), u.end(), Clamp(), 3.0);
+	pass = true;
+	for (auto i=0; i<u.size(); i++) pass &= (u[i] == std::min(std::max(-5.0 + 0.01*i, 0.0), 3.0));
+	check("for_each_simd_parallel", pass);
+
+	// raw pointers are contiguous too
+	float f[10] = {0};
+	simbox::for_each_simd<8>(f, f+10, [](auto & x){x += 1.0f;});
+	check("pointer range", f[0] == 1.0f && f[9] == 1.0f);
+
+	// read-only and bit-packed ranges are rejected by the static_assert
+	check("contiguous iterators", simbox::is_contiguous_iterator<std::vector<double>::iterator>::value
+							   && !simbox::is_contiguous_iterator<std::vector<double>::const_iterator>::value
+							   && !simbox::is_contiguous_iterator<const float *>::value
+							   && !simbox::is_contiguous_iterator<std::vector<bool>::iterator>::value);
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "../include/SoANodeContainer.hpp"
+#include "../include/GenericMesh.hpp"
+#include "../include/ForEach.hpp"
+#include "../include/ZipSort.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+template <typename T>
+bool aligned(const T * p) {return reinterpret_cast<std::uintptr_t>(p) % 64 == 0;}
+
+
+typedef simbox::soa_node_container<2, double, float, int> 	node_cont;
+typedef std::vector<std::pair<int, int>> 					cell_base;
+
+struct cell_cont : public cell_base{
+	cell_cont & cells() {return *this;};
+};
+
+// nodes are visited by proxy, so the policy takes them by value
+struct NodeInterface{
+	static node_cont::reference get(node_cont::reference n) {return n;};
+};
+
+struct Scale{
+	void operator()(node_cont::reference n, double s) const {
+		n.x() *= s;
+		n.get<0>() = float(n.x() + n.y());
+	}
+};
+
+
+int main(int argc, char * argv[]){
+	simbox::GenericMesh<node_cont, void, cell_cont> mesh;
+
+	// push in 21 nodes from 0.0 to 1.0
+	for (auto i=0; i<=20; i++) mesh.nodes().emplace_back({0.05*i, 1.0}, 0.0f, i);
+	for (auto i=0; i<20; i++) mesh.cells().push_back(std::make_pair(i, i+1));
+
+	// proxies keep the syntax of node objects
+	bool pass = true;
+	for (auto it=mesh.nodes().begin(); it!=mesh.nodes().end(); it++){
+		it->get<0>() = float(it->x());
+		pass &= ((*it).y() == 1.0) && (it->get<1>() == int(it - mesh.nodes().begin()));
+	}
+	pass &= (mesh.nodes()[4].get<0>() == 0.2f) && (mesh.nodes().field<0>()[4] == 0.2f);
+	check("proxy access", pass && mesh.nodes().size() == 21 && mesh.cells().size() == 20);
+
+	// every component is its own aligned array
+	pass = true;
+	for (auto i=0; i<100; i++) mesh.nodes().push_back(node_cont::value_type({1.0, 2.0}, 3.0f, 4));
+	pass &= aligned(mesh.nodes().coordinate(0).data()) && aligned(mesh.nodes().coordinate(1).data());
+	pass &= aligned(mesh.nodes().field<0>().data()) && aligned(mesh.nodes().field<1>().data());
+	check("aligned arrays", pass && mesh.nodes().coordinate(1)[50] == 2.0);
+	mesh.nodes().resize(21);
+
+	// values and references
+	node_cont::value_type v = mesh.nodes()[3];
+	mesh.nodes()[0] = v;
+	mesh.nodes()[1] = mesh.nodes()[2];
+	pass = (mesh.nodes()[0].x() == v.x()) && (mesh.nodes()[0].get<1>() == 3) && (mesh.nodes()[1].get<1>() == 2);
+	const node_cont & cn = mesh.nodes();
+	node_cont::const_iterator cit = mesh.nodes().begin();
+	pass &= (cn[5].x() == 0.25) && (cit[5].get<1>() == 5) && (cn.end() - cit == 21);
+	check("values and references", pass);
+	mesh.nodes()[0] = node_cont::value_type({0.0, 1.0}, 0.0f, 0);
+	mesh.nodes()[1] = node_cont::value_type({0.05, 1.0}, 0.05f, 1);
+
+	// std algorithms move whole nodes. Comparisons may get both proxies
+	// and node values, which have the same accessors
+	std::sort(mesh.nodes().begin(), mesh.nodes().end(), [](const auto & a, const auto & b){return a.template get<1>() > b.template get<1>();});
+	pass = true;
+	for (auto i=0; i<21; i++) pass &= (mesh.nodes()[i].get<1>() == 20-i) && (float(mesh.nodes()[i].x()) == mesh.nodes()[i].get<0>());
+	check("std::sort", pass);
+
+	std::vector<std::size_t> perm(21);
+	for (auto i=0; i<21; i++) perm[i] = 20-i;
+	simbox::apply_permutation(mesh.nodes().begin(), mesh.nodes().end(), perm);
+	pass = true;
+	for (auto i=0; i<21; i++) pass &= (mesh.nodes()[i].get<1>() == i) && (mesh.nodes()[i].x() == 0.05*i);
+	check("apply_permutation", pass);
+
+	// parallel loops over proxies, and vectorized loops over one array
+	simbox::for_each_parallel<NodeInterface>(mesh.nodes().begin(), mesh.nodes().end(), Scale(), 2.0);
+	double * y = mesh.nodes().coordinate(1).data();
+	#pragma omp simd
+	for (std::size_t i=0; i<mesh.nodes().size(); i++) y[i] += 1.0;
+	pass = true;
+	for (auto i=0; i<21; i++) pass &= (mesh.nodes()[i].x() == 2.0*(0.05*i)) && (mesh.nodes()[i].y() == 2.0) && (mesh.nodes()[i].get<0>() == float(2.0*(0.05*i) + 1.0));
+	check("parallel and vectorized kernels", pass);
+
+	// nodes placed by the threads that work on them, then grown serially
+	node_cont big;
+	big.first_touch_resize(100000, node_cont::value_type({1.0, 2.0}, 3.0f, 4));
+	simbox::for_each_parallel<NodeInterface>(big.begin(), big.end(), Scale(), 2.0);
+	big.resize(100010);
+	pass = aligned(big.coordinate(0).data()) && aligned(big.field<1>().data());
+	for (std::size_t i=0; i<100000; i++) pass &= (big[i].x() == 2.0) && (big[i].y() == 2.0) && (big[i].get<0>() == 4.0f) && (big[i].get<1>() == 4);
+	for (std::size_t i=100000; i<big.size(); i++) pass &= (big[i].x() == 0.0) && (big[i].get<1>() == 0);
+	check("first touch resize", pass);
+
+	// 3d nodes without fields
+	simbox::soa_node_container<3> n3;
+	n3.emplace_back({1.0, 2.0, 3.0});
+	n3.begin()->z() += 1.0;
+	check("3d nodes", n3[0].z() == 4.0 && n3.at(0).coord(1) == 2.0);
+
+	return 0;
+}
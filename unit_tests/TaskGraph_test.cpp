@@ -0,0 +1,98 @@
+#include "../include/TaskGraph.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+struct AddTo{
+	void operator()(double & d, double a) const {d += a;};
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::vector<double> E(1000, 0.0), H(1000, 0.0), out(1000, 0.0);
+	double dft = 0;
+	std::vector<std::string> log;
+
+	// one time step: H and the boundary of E are independent, the E update
+	// needs H, and output staging of the old E can overlap the H update
+	simbox::TaskGraph g;
+	g.add([&](){out = E;}, {&E}, {&out}, "stage output");
+	g.add_for_each<Identity>(H.begin(), H.end(), AddTo(), {&H}, {&H}, "update H", 1.0);
+	g.add([&](){for (auto i=0; i<E.size(); i++) E[i] += H[i];}, {&E, &H}, {&E}, "update E");
+	g.add([&](){for (auto i=0; i<E.size(); i++) dft += E[i];}, {&E}, {&dft}, "accumulate");
+	g.print_summary();
+	check("loop task names", g.name(1) == "update H" && g.name(2) == "update E");
+
+	for (auto step=0; step<5; step++) g.run();
+
+	// same as running the tasks in order 5 times: H = 5, E = 1+2+3+4+5
+	bool pass = (H[0] == 5.0 && E[0] == 15.0 && out[0] == 10.0);
+	pass &= (dft == 1000.0*(1+3+6+10+15));
+	check("time steps", pass);
+
+	// the update of E waits for the staging of the old E (write after read)
+	simbox::TaskGraph g2;
+	int value = 0, staged = -1;
+	g2.add([&](){staged = value;}, {&value}, {&staged});
+	g2.add([&](){value = 7;}, {}, {&value});
+	g2.run();
+	check("write after read", staged == 0 && value == 7);
+
+	// exceptions are passed to the caller
+	simbox::TaskGraph g3;
+	g3.add([](){throw std::runtime_error("task failed");}, {}, {});
+	bool caught = false;
+	try {g3.run();}
+	catch (std::runtime_error & e) {caught = true;}
+	check("exceptions", caught);
+
+	// a parallel kernel inside a task runs on an omp team of its own, and
+	// one that asks for the pool running the graph is refused
+	simbox::TaskGraph g4;
+	std::vector<double> F(100000, 0.0);
+	std::vector<int> team(omp_get_max_threads(), 0);
+	g4.add_for_each_parallel<Identity>(F.begin(), F.end(), AddTo(), {}, {&F}, "fill F", 2.0);
+	g4.add([&](){
+		#pragma omp parallel
+		team[omp_get_thread_num()] = omp_get_num_threads();
+	}, {}, {&team});
+	g4.run();
+	pass = true;
+	for (auto it=F.begin(); it!=F.end(); it++) pass &= (*it == 2.0);
+	for (auto it=team.begin(); it!=team.end(); it++) pass &= (*it == omp_get_max_threads());
+	check("parallel kernel in a task", pass);
+
+	// whatever the size of the pool or of the loop
+	pass = true;
+	for (int nthreads=1; nthreads<=4; nthreads*=2){
+		simbox::ThreadPool pool(nthreads);
+		for (std::size_t n=1; n<=F.size(); n*=100){
+			simbox::TaskGraph g5;
+			g5.add([&](){simbox::for_each_parallel<Identity>(pool, F.begin(), F.begin()+n, AddTo(), 1.0);}, {}, {&F}, "pool kernel");
+			caught = false;
+			try {g5.run(pool);}
+			catch (std::logic_error & e) {caught = true;}
+			pass &= caught;
+		}
+	}
+	pass &= (F[0] == 2.0 && F.back() == 2.0);
+	check("pool kernel in a task", pass);
+
+	return 0;
+}
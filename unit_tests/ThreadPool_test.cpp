@@ -0,0 +1,131 @@
+#include "../include/ThreadPool.hpp"
+#include "../include/ForEach.hpp"
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+
+
+
+// interface that passes the dereferenced iterator through unchanged
+struct Identity{
+	template <typename T>
+	static T & get(T & t) {return t;};
+};
+
+struct Axpy{
+	void operator()(double & d, double a) const {d += a;};
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+#ifdef __linux__
+	cpu_set_t before, after;
+	pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &before);
+#endif
+	simbox::ThreadPool pool(0, simbox::Affinity::COMPACT);
+	std::cout << "pool threads: " << pool.num_threads() << std::endl;
+#ifdef __linux__
+	pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &after);
+	check("caller not pinned", CPU_EQUAL(&before, &after));
+#endif
+
+	// every thread runs every job exactly once
+	std::atomic<int> count(0);
+	std::vector<int> seen(pool.num_threads(), 0);
+	for (auto i=0; i<1000; i++){
+		pool.run([&](int tid){
+			count++;
+			seen[tid]++;
+		});
+	}
+	bool pass = (count == 1000*pool.num_threads());
+	for (auto it=seen.begin(); it!=seen.end(); it++) pass &= (*it == 1000);
+	check("team dispatch", pass);
+
+	// jobs submitted from several threads run one after the other
+	std::atomic<int> inside(0), overlap(0);
+	count = 0;
+	auto submit = [&](){
+		for (auto i=0; i<200; i++){
+			pool.run([&](int tid){
+				if (tid == 0 && inside.fetch_add(1) != 0) overlap++;
+				count++;
+				if (tid == 0) inside--;
+			});
+		}
+	};
+	std::thread other(submit);
+	submit();
+	other.join();
+	check("concurrent submitters", count == 400*pool.num_threads() && overlap == 0);
+
+	// an exception on any thread reaches the caller once every thread is
+	// done, and the pool keeps working
+	for (auto thrower=0; thrower<pool.num_threads(); thrower++){
+		std::atomic<int> done(0);
+		bool caught = false;
+		try {
+			pool.run([&](int tid){
+				if (tid == thrower) throw std::runtime_error("job");
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				done++;
+			});
+		}
+		catch (const std::runtime_error &) {caught = true;}
+		pass = caught && (done == pool.num_threads()-1);
+		count = 0;
+		pool.run([&](int){count++;});
+		check("exception on thread " + std::to_string(thrower), pass && count == pool.num_threads());
+	}
+
+	// a job of another pool restores this pool as the current one
+	simbox::ThreadPool inner(2);
+	std::atomic<int> nested(0);
+	pool.run([&](int tid){
+		if (tid != 0) return;
+		inner.run([&](int){nested++;});
+		try {pool.run([](int){});} catch (const std::logic_error &) {nested += 10;}
+	});
+	check("nested pools", nested == 12);
+
+	// many small loops on the pool
+	std::vector<double> v(2000, 0.0);
+	std::list<double> l(500, 0.0);
+	double start = omp_get_wtime();
+	for (auto i=0; i<5000; i++){
+		simbox::for_each_parallel<Identity>(pool, v.begin(), v.end(), Axpy(), 1.0);
+	}
+	double tpool = omp_get_wtime() - start;
+	for (auto i=0; i<100; i++){
+		simbox::for_each_parallel<Identity>(pool, l.begin(), l.end(), Axpy(), 1.0);
+	}
+	pass = true;
+	for (auto it=v.begin(); it!=v.end(); it++) pass &= (*it == 5000.0);
+	for (auto it=l.begin(); it!=l.end(); it++) pass &= (*it == 100.0);
+	check("for_each_parallel on pool", pass);
+
+	start = omp_get_wtime();
+	for (auto i=0; i<5000; i++){
+		simbox::for_each_parallel<Identity>(v.begin(), v.end(), Axpy(), 1.0);
+	}
+	double tomp = omp_get_wtime() - start;
+	std::cout << "5000 small loops: pool " << tpool << "s, omp " << tomp << "s" << std::endl;
+
+	// the shared pool through the execution policy
+	simbox::for_each(simbox::exec::pool, v.begin(), v.end(), Axpy(), 1.0);
+	check("exec::pool", v[0] == 10001.0 && v.back() == 10001.0);
+
+	return 0;
+}
@@ -1,10 +1,30 @@
 #include "../include/ZipIterator.hpp"
+#include "../include/ForEach.hpp"
 
 
 
 #include <tuple>
 #include <iostream>
 #include <vector>
+#include <string>
+#include <algorithm>
+
+
+// interface that passes the zipped reference through
+struct ZipInterface{
+	template <typename T>
+	static T get(T t) {return t;};
+};
+
+struct Axpy{
+	template <typename Ref>
+	void operator()(Ref r, double a) const {std::get<2>(r) = a*std::get<0>(r) + std::get<1>(r);};
+};
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
 
 
 int main(int argc, char * argv[]){
@@ -30,5 +50,36 @@ int main(int argc, char * argv[]){
 		val++;
 	}
 
+
+	// random access arithmetic
+	check("distance", zitend - zit == 10);
+	check("offset", (zit + 3).get<0>() == 3 && std::get<1>(zit[4]) == 5 && (zitend - 1).get<0>() == 9);
+	auto mid = zit; mid += 5; mid--;
+	check("ordering", zit < mid && mid <= zitend && zitend > mid && mid - zit == 4);
+
+
+	// sort both arrays by the second one, descending
+	std::sort(zit, zitend, [](const std::tuple<int, int> & a, const std::tuple<int, int> & b){
+		return std::get<1>(a) > std::get<1>(b);
+	});
+	bool sorted = true;
+	for (auto i=0; i<10; i++) sorted = sorted && v1[i] == 9-i && v2[i] == 10-i;
+	check("std::sort", sorted);
+
+	// sort with the default lexicographic ordering
+	std::sort(zit, zitend);
+	sorted = true;
+	for (auto i=0; i<10; i++) sorted = sorted && v1[i] == i && v2[i] == i+1;
+	check("std::sort lexicographic", sorted);
+
+
+	// parallel loop over a zipped SoA range
+	std::size_t n = 10000;
+	std::vector<double> x(n, 2.0), y(n, 1.0), z(n, 0.0);
+	auto zb = simbox::make_zip_iterator(x.begin(), y.begin(), z.begin());
+	auto ze = simbox::make_zip_iterator(x.end(), y.end(), z.end());
+	simbox::for_each_parallel<ZipInterface>(zb, ze, Axpy(), 3.0);
+	check("for_each_parallel", std::all_of(z.begin(), z.end(), [](double d){return d == 7.0;}));
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,81 @@
+#include "../include/ZipSort.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+
+
+void check(std::string name, bool pass){
+	std::cout << name << ": " << (pass ? "succeeded" : "FAILED") << std::endl;
+}
+
+
+int main(int argc, char * argv[]){
+
+	std::size_t n = 100000;
+	std::mt19937 gen(7);
+
+	// parallel arrays: a partition id, a coordinate and an id that
+	// records the original position
+	std::vector<int> part(n);
+	std::vector<double> x(n);
+	std::vector<std::size_t> ids(n);
+	for (std::size_t i=0; i<n; i++){
+		part[i] = int(gen() % 2001) - 1000;
+		x[i] = 0.5*part[i];
+		ids[i] = i;
+	}
+	std::vector<int> part0 = part;
+
+	auto beg = simbox::make_zip_iterator(part.begin(), x.begin(), ids.begin());
+	auto end = simbox::make_zip_iterator(part.end(), x.end(), ids.end());
+
+	// radix path (signed integer key)
+	simbox::zip_sort<0>(beg, end);
+	bool pass = std::is_sorted(part.begin(), part.end());
+	for (std::size_t i=0; i<n; i++) pass = pass && x[i] == 0.5*part[i] && part0[ids[i]] == part[i];
+	for (std::size_t i=1; i<n; i++) if (part[i] == part[i-1]) pass = pass && ids[i] > ids[i-1];
+	check("radix zip_sort", pass);
+
+	// comparison path (floating point key, descending)
+	simbox::zip_sort<1>(beg, end, std::greater<double>());
+	pass = std::is_sorted(x.rbegin(), x.rend());
+	for (std::size_t i=0; i<n; i++) pass = pass && x[i] == 0.5*part[i] && part0[ids[i]] == part[i];
+	for (std::size_t i=1; i<n; i++) if (part[i] == part[i-1]) pass = pass && ids[i] > ids[i-1];
+	check("comparison zip_sort", pass);
+
+	// unsigned key back to the original order
+	simbox::zip_sort<2>(beg, end);
+	check("restore original order", part == part0);
+
+	// permutation on its own, applied to another array afterwards
+	std::vector<unsigned long> morton(n);
+	for (std::size_t i=0; i<n; i++) morton[i] = (gen() % 1000) << 40;
+	auto perm = simbox::sort_permutation<0>(simbox::make_zip_iterator(std::make_tuple(morton.begin())), simbox::make_zip_iterator(std::make_tuple(morton.end())));
+	simbox::apply_permutation(simbox::make_zip_iterator(morton.begin(), ids.begin()),
+							  simbox::make_zip_iterator(morton.end(), ids.end()), perm);
+	pass = std::is_sorted(morton.begin(), morton.end());
+	for (std::size_t i=0; i<n; i++) pass = pass && ids[i] == perm[i];
+	check("sort_permutation", pass);
+
+	// the merge rounds for any team size, including teams larger than
+	// the number of threads the runtime starts
+	pass = true;
+	for (int nthreads=1; nthreads<=9; nthreads++){
+		std::vector<std::pair<double, std::size_t>> pairs(10007), expected;
+		for (std::size_t i=0; i<pairs.size(); i++) pairs[i] = std::make_pair(double(gen() % 50), i);
+		expected = pairs;
+		std::stable_sort(expected.begin(), expected.end(), [](const std::pair<double, std::size_t> & a, const std::pair<double, std::size_t> & b){return a.first > b.first;});
+
+		simbox::OmpTeam team(nthreads);
+		simbox::Detail::merge_sort_pairs(team, pairs, std::greater<double>());
+		pass = pass && (pairs == expected);
+	}
+	check("parallel merge rounds", pass);
+
+	return 0;
+}